@@ -0,0 +1,58 @@
+#!/bin/sh
+# Kernel-to-prompt time of init.cpio under each compression.
+#
+#   bench/boot.sh <bzImage> <runs> <spec> <mkinitramfs>
+#
+# Each variant is booted <runs> times in headless QEMU (KVM when available)
+# with the console in a log file. The figure is the one init prints once the
+# boot units have settled ("shell ready N ms after boot"): guest
+# CLOCK_MONOTONIC, which starts with the kernel and so includes unpacking
+# the image. Variants whose compressor is missing are skipped; a kernel
+# without the matching CONFIG_RD_* option never reaches the prompt.
+
+set -u
+
+KERNEL=$1
+RUNS=$2
+SPEC=$3
+MKINITRAMFS=$4
+OUT=bench/out/boot
+TIMEOUT=${BOOT_TIMEOUT:-60}
+
+ACCEL="-accel tcg"
+if [ -w /dev/kvm ]; then
+    ACCEL="-accel kvm -cpu host"
+fi
+
+mkdir -p "$OUT"
+printf '%-6s %10s %10s %10s %10s\n' image bytes median_ms min_ms max_ms
+for c in none gzip lz4 zstd; do
+    img=$OUT/init-$c.cpio
+    if ! "$MKINITRAMFS" -c "$c" -o "$img" "$SPEC" 2>"$OUT/$c.err"; then
+        printf '%-6s skipped: %s\n' "$c" "$(tail -n 1 "$OUT/$c.err")"
+        continue
+    fi
+    times=
+    for i in $(seq "$RUNS"); do
+        log=$OUT/$c-$i.log
+        : >"$log"
+        qemu-system-x86_64 $ACCEL -m 256M -kernel "$KERNEL" -initrd "$img" \
+            -append "console=ttyS0 quiet panic=-1" -no-reboot \
+            -display none -monitor none -serial "file:$log" &
+        pid=$!
+        deadline=$(($(date +%s) + TIMEOUT))
+        while ! grep -q 'shell ready' "$log" && kill -0 "$pid" 2>/dev/null && [ "$(date +%s)" -lt "$deadline" ]; do
+            sleep 0.1
+        done
+        kill "$pid" 2>/dev/null
+        wait "$pid" 2>/dev/null
+        t=$(sed -n 's/.*shell ready \([0-9.]*\) ms after boot.*/\1/p' "$log")
+        times="$times $t"
+    done
+    if [ -z "$(echo $times)" ]; then
+        printf '%-6s no prompt, see %s\n' "$c" "$OUT/$c-1.log"
+        continue
+    fi
+    echo $times | tr ' ' '\n' | sort -n | awk -v c="$c" -v b="$(stat -c %s "$img")" \
+        '{ v[NR] = $1 } END { printf "%-6s %10d %10.1f %10.1f %10.1f\n", c, b, v[int((NR + 1) / 2)], v[1], v[NR] }'
+done
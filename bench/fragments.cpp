@@ -0,0 +1,137 @@
+// cat over many small files: the io_uring prefetch path against the
+// sequential one (CAT_URING=0).
+//
+//   fragments <dir> <count> <bindir> [<tool dir>]
+//
+// Writes <count> files of 64 B to 4 KiB into <dir>/fragment-files and
+// concatenates them all in one cat call, output to /dev/null, optionally
+// next to cat from <tool dir>, e.g. /usr/bin. Runs with a warm page cache,
+// and also cold when /proc/sys/vm/drop_caches is writable (root), which is
+// where overlapping the opens and reads matters most. Median of 5, in ms.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/util.hpp"
+
+extern char** environ;
+
+constexpr int RUNS = 5;
+
+static double now_s()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+static bool drop_caches()
+{
+    sync();
+    FD fd(open("/proc/sys/vm/drop_caches", O_WRONLY));
+    return fd && write_all(fd.get(), "3\n", 2);
+}
+
+// Median wall time of `cat <names...>`, run in dir with extra in the
+// environment; 0 if the binary cannot be started.
+static double run_cat(const std::string& cat, const std::string& dir, const std::vector<std::string>& names,
+                      const char* extra, bool cold)
+{
+    std::vector<char*> argv{const_cast<char*>(cat.c_str())};
+    for (const std::string& n : names)
+        argv.push_back(const_cast<char*>(n.c_str()));
+    argv.push_back(nullptr);
+    std::vector<char*> envp;
+    for (char** e = environ; *e; ++e)
+        envp.push_back(*e);
+    if (extra)
+        envp.push_back(const_cast<char*>(extra));
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addchdir_np(&fa, dir.c_str());
+    std::vector<double> times;
+    for (int i = 0; i < RUNS; ++i)
+    {
+        if (cold)
+            drop_caches();
+        double t0 = now_s();
+        pid_t pid;
+        if (posix_spawn(&pid, cat.c_str(), &fa, nullptr, argv.data(), envp.data()) != 0)
+            return 0;
+        int status;
+        waitpid(pid, &status, 0);
+        times.push_back(now_s() - t0);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::fprintf(stderr, "usage: %s <dir> <count> <bindir> [<tool dir>]\n", argv[0]);
+        return 2;
+    }
+    // Not <dir>/fragments: make puts this program there.
+    std::string dir = std::string(argv[1]) + "/fragment-files";
+    int count = std::atoi(argv[2]);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        std::perror(dir.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    std::vector<char> data(4096);
+    unsigned seed = 1;
+    for (char& c : data)
+        c = static_cast<char>('a' + (seed = seed * 1103515245 + 12345) % 26);
+    for (int i = 0; i < count; ++i)
+    {
+        names.push_back(std::to_string(i));
+        size_t size = 64 + ((seed = seed * 1103515245 + 12345) >> 16) % (data.size() - 64);
+        std::string path = dir + "/" + names.back();
+        FD fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        if (!fd || !write_all(fd.get(), data.data(), size))
+        {
+            std::perror(path.c_str());
+            return 1;
+        }
+    }
+
+    std::string cat = std::string(argv[3]) + "/cat";
+    if (cat[0] != '/')
+        cat = std::string(getcwd(nullptr, 0)) + "/" + cat;
+    bool cold = drop_caches();
+    std::printf("%-16s %10s %10s\n", "cat", "warm ms", cold ? "cold ms" : "");
+    auto row = [&](const char* label, const std::string& bin, const char* extra) {
+        std::printf("%-16s %10.1f", label, run_cat(bin, dir, names, extra, false) * 1e3);
+        if (cold)
+            std::printf(" %10.1f", run_cat(bin, dir, names, extra, true) * 1e3);
+        std::printf("\n");
+    };
+    row("sequential", cat, "CAT_URING=0");
+    row("io_uring", cat, nullptr);
+    if (argc > 4)
+        row("reference", std::string(argv[4]) + "/cat", nullptr);
+
+    for (const std::string& n : names)
+        unlink((dir + "/" + n).c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
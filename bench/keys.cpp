@@ -0,0 +1,701 @@
+// Keystroke latency, terminal output and system calls of the shell (init)
+// and edit, replayed from transcripts under a pseudo-terminal.
+//
+//   keys <bindir> <transcript dir> <out dir> [<baseline>]
+//
+// A transcript (<transcript dir>/*.keys) names the program and its input,
+// one event per line; escapes are \e \r \n \t \\ and \xHH:
+//
+//   program edit {big}     run bindir/edit on the generated 100k-line file
+//   type cd /tmp           one keystroke per character
+//   key \e[A               one keystroke
+//   paste echo a\necho b   one bracketed paste
+//   repeat 40 key \e[B     an event, several times
+//
+// {out} is the output directory. A keystroke is done when the program is
+// back in a wait (read of the terminal, poll, select, epoll) with all input
+// consumed and no child process left. Latency runs trap only those calls,
+// through a seccomp filter, so tracing costs one stop per keystroke; a
+// separate, fully traced run counts the system calls of each keystroke,
+// children included, and the bytes written to the terminal.
+//
+// Results go to <out dir>/results.txt and each program's terminal output to
+// <out dir>/<name>.out. Given a baseline (an earlier results.txt), the exit
+// status is 1 when a transcript's system calls or bytes per key grow by more
+// than COUNT_SLACK, or its median latency by more than LATENCY_SLACK times.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <map>
+#include <poll.h>
+#include <stddef.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/syscall.hpp"
+#include "../src/include/util.hpp"
+
+constexpr int RUNS = 3;
+constexpr int ROWS = 24;
+constexpr int COLS = 80;
+constexpr int BIG_LINES = 100000;
+constexpr int KEY_TIMEOUT_MS = 10000;
+constexpr double COUNT_SLACK = 0.05;
+constexpr double LATENCY_SLACK = 3.0;
+
+constexpr long NR_READ = sys::info(sys::Nr::read).nr;
+constexpr long NR_WRITE = sys::info(sys::Nr::write).nr;
+constexpr long NR_WRITEV = sys::info(sys::Nr::writev).nr;
+
+// Calls that block for terminal input; read counts only on fd 0.
+constexpr sys::Nr WAITS[] = {sys::Nr::poll,  sys::Nr::select,      sys::Nr::epoll_wait,  sys::Nr::pselect6,
+                             sys::Nr::ppoll, sys::Nr::epoll_pwait, sys::Nr::epoll_pwait2};
+
+static bool is_wait(long nr, uint64_t fd)
+{
+    if (nr == NR_READ)
+        return fd == 0;
+    return std::any_of(std::begin(WAITS), std::end(WAITS), [&](sys::Nr w) { return sys::info(w).nr == nr; });
+}
+
+static std::string call_name(long nr)
+{
+    const char* name = sys::name_of(nr);
+    return name ? name : "#" + std::to_string(nr);
+}
+
+static double now_us()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) * 1e6 + static_cast<double>(ts.tv_nsec) / 1e3;
+}
+
+// Traps the waits for the tracer and lets everything else through.
+static bool install_filter()
+{
+    std::vector<sock_filter> f;
+    f.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+    f.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0));
+    f.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    f.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+    for (sys::Nr w : WAITS)
+    {
+        f.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(sys::info(w).nr), 0, 1));
+        f.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    }
+    f.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, NR_READ, 1, 0));
+    f.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    f.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, args[0])));
+    f.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1));
+    f.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    f.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    sock_fprog prog{static_cast<unsigned short>(f.size()), f.data()};
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+}
+
+// One program under a pty and ptrace. In count mode every system call
+// stops; otherwise only the waits do.
+class Session
+{
+  public:
+    std::string output{};
+    size_t calls{0}; // during the last key
+    size_t bytes{0};
+    std::map<long, size_t> mix{}; // system calls of all keys
+    bool exited{false};
+
+    ~Session()
+    {
+        stop();
+    }
+
+    bool start(const std::vector<std::string>& argv, const std::vector<std::string>& env, bool counting)
+    {
+        count = counting;
+        master = FD(posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK));
+        if (!master || grantpt(master.get()) != 0 || unlockpt(master.get()) != 0)
+            return false;
+        winsize ws{ROWS, COLS, 0, 0};
+        ioctl(master.get(), TIOCSWINSZ, &ws);
+        std::string slave = ptsname(master.get());
+
+        sigset_t chld, old;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &old);
+        sigfd = FD(signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC));
+
+        std::vector<char*> args, envp;
+        for (const std::string& a : argv)
+            args.push_back(const_cast<char*>(a.c_str()));
+        args.push_back(nullptr);
+        for (const std::string& e : env)
+            envp.push_back(const_cast<char*>(e.c_str()));
+        envp.push_back(nullptr);
+
+        pid = fork();
+        if (pid == 0)
+        {
+            setsid();
+            int fd = open(slave.c_str(), O_RDWR);
+            ioctl(fd, TIOCSCTTY, 0);
+            dup2(fd, 0);
+            dup2(fd, 1);
+            dup2(fd, 2);
+            if (fd > 2)
+                close(fd);
+            sigprocmask(SIG_SETMASK, &old, nullptr);
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+            if (!count && !install_filter())
+                _exit(126);
+            raise(SIGSTOP);
+            execve(args[0], args.data(), envp.data());
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+            return false;
+        long opts = PTRACE_O_EXITKILL | PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                    PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | (count ? 0 : PTRACE_O_TRACESECCOMP);
+        ptrace(PTRACE_SETOPTIONS, pid, nullptr, opts);
+        tasks[pid].started = true;
+        resume(pid, 0);
+        if (!settle())
+            return false;
+        mix.clear();
+        calls = bytes = 0;
+        return true;
+    }
+
+    // Sends one keystroke and waits until it is handled; false on a
+    // timeout. The time is in us.
+    bool key(const std::string& data, double& us)
+    {
+        calls = bytes = 0;
+        idle = false;
+        pending = data;
+        sent += data.size();
+        double t0 = now_us();
+        feed();
+        bool ok = settle();
+        us = done_at - t0;
+        return ok;
+    }
+
+    // Kills the program if it is still running and collects what is left.
+    void stop()
+    {
+        if (pid <= 0)
+            return;
+        if (!exited)
+            kill(pid, SIGKILL);
+        double deadline = now_us() + KEY_TIMEOUT_MS * 1e3;
+        while (!tasks.empty() && now_us() < deadline)
+            pump(100);
+        drain();
+        pid = 0;
+    }
+
+  private:
+    struct Task
+    {
+        bool started{false};
+        bool watch{false}; // stop at the exit of this read of the terminal
+        long nr{-1};
+        uint64_t fd{0};
+    };
+
+    FD master{};
+    FD sigfd{};
+    pid_t pid{0};
+    bool count{false};
+    std::map<pid_t, Task> tasks{};
+    std::string pending{}; // keystroke bytes the pty did not take yet
+    size_t sent{0};
+    size_t consumed{0};
+    bool idle{false};
+    double done_at{0};
+
+    bool settle()
+    {
+        double deadline = now_us() + KEY_TIMEOUT_MS * 1e3;
+        while (!idle && !exited)
+        {
+            if (now_us() > deadline)
+                return false;
+            pump(KEY_TIMEOUT_MS);
+        }
+        return true;
+    }
+
+    void feed()
+    {
+        while (!pending.empty())
+        {
+            ssize_t n = write(master.get(), pending.data(), pending.size());
+            if (n <= 0)
+                return;
+            pending.erase(0, static_cast<size_t>(n));
+        }
+    }
+
+    void drain()
+    {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(master.get(), buf, sizeof buf)) > 0)
+            output.append(buf, static_cast<size_t>(n));
+    }
+
+    void pump(int timeout_ms)
+    {
+        pollfd p[2] = {{master.get(), static_cast<short>(POLLIN | (pending.empty() ? 0 : POLLOUT)), 0},
+                       {sigfd.get(), POLLIN, 0}};
+        if (exited)
+            p[0].fd = -1; // hung up
+        if (poll(p, 2, timeout_ms) <= 0)
+            return;
+        if (p[0].revents & POLLIN)
+            drain();
+        if (p[0].revents & POLLOUT)
+            feed();
+        if (p[1].revents & POLLIN)
+        {
+            signalfd_siginfo si;
+            while (read(sigfd.get(), &si, sizeof si) == sizeof si)
+            {
+            }
+            int status;
+            pid_t who;
+            while ((who = waitpid(-1, &status, __WALL | WNOHANG)) > 0)
+                on_stop(who, status);
+        }
+    }
+
+    void resume(pid_t who, int sig)
+    {
+        bool step = count || tasks[who].watch;
+        ptrace(step ? PTRACE_SYSCALL : PTRACE_CONT, who, nullptr, sig);
+    }
+
+    void waiting(pid_t who)
+    {
+        if (who == pid && tasks.size() == 1 && pending.empty() && consumed == sent && !idle)
+        {
+            idle = true;
+            done_at = now_us();
+        }
+    }
+
+    void on_stop(pid_t who, int status)
+    {
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            tasks.erase(who);
+            if (who == pid)
+            {
+                exited = true;
+                done_at = now_us();
+            }
+            return;
+        }
+        if (!WIFSTOPPED(status))
+            return;
+        Task& t = tasks[who];
+        int sig = WSTOPSIG(status);
+        int event = status >> 16;
+        if (sig == (SIGTRAP | 0x80) || (sig == SIGTRAP && event == PTRACE_EVENT_SECCOMP))
+        {
+            on_syscall(who, t);
+            resume(who, 0);
+        }
+        else if (sig == SIGTRAP && event != 0)
+        {
+            // Known from here on, so the parent is not idle while it runs.
+            unsigned long child;
+            if (event != PTRACE_EVENT_EXEC && ptrace(PTRACE_GETEVENTMSG, who, nullptr, &child) == 0)
+                tasks.try_emplace(static_cast<pid_t>(child));
+            resume(who, 0);
+        }
+        else if (sig == SIGSTOP && !t.started)
+        {
+            t.started = true; // a new child's first stop
+            resume(who, 0);
+        }
+        else
+        {
+            resume(who, sig);
+        }
+    }
+
+    void on_syscall(pid_t who, Task& t)
+    {
+        __ptrace_syscall_info info{};
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, who, sizeof info, &info) <= 0)
+            return;
+        if (info.op == PTRACE_SYSCALL_INFO_EXIT)
+        {
+            int64_t r = info.exit.rval;
+            if (who == pid && t.nr == NR_READ && t.fd == 0 && r > 0)
+                consumed += static_cast<size_t>(r);
+            if ((t.nr == NR_WRITE || t.nr == NR_WRITEV) && (t.fd == 1 || t.fd == 2) && r > 0)
+                bytes += static_cast<size_t>(r);
+            t.watch = false;
+            return;
+        }
+        bool entry = info.op == PTRACE_SYSCALL_INFO_ENTRY;
+        t.nr = static_cast<long>(entry ? info.entry.nr : info.seccomp.nr);
+        t.fd = entry ? info.entry.args[0] : info.seccomp.args[0];
+        if (entry)
+        {
+            calls++;
+            mix[t.nr]++;
+        }
+        else if (t.nr == NR_READ)
+        {
+            t.watch = true; // count what it reads
+        }
+        if (is_wait(t.nr, t.fd))
+            waiting(who);
+    }
+};
+
+struct Transcript
+{
+    std::string name{};
+    std::vector<std::string> argv{};
+    std::vector<std::string> keys{};
+    bool big{false}; // runs on the generated file
+};
+
+static std::string unescape(const std::string& s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] != '\\' || i + 1 == s.size())
+        {
+            out += s[i];
+            continue;
+        }
+        char c = s[++i];
+        if (c == 'e')
+            out += '\x1b';
+        else if (c == 'r')
+            out += '\r';
+        else if (c == 'n')
+            out += '\n';
+        else if (c == 't')
+            out += '\t';
+        else if (c == 'x' && i + 2 < s.size())
+        {
+            out += static_cast<char>(std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        }
+        else
+            out += c;
+    }
+    return out;
+}
+
+static std::string replace_all(std::string s, const std::string& from, const std::string& to)
+{
+    for (size_t at = s.find(from); at != std::string::npos; at = s.find(from, at + to.size()))
+        s.replace(at, from.size(), to);
+    return s;
+}
+
+static bool add_event(Transcript& t, const std::string& line, const std::string& bindir, const std::string& out)
+{
+    size_t sp = line.find(' ');
+    std::string op = line.substr(0, sp);
+    std::string arg = sp == std::string::npos ? "" : line.substr(sp + 1);
+    if (op == "program")
+    {
+        t.argv.clear();
+        t.big = arg.find("{big}") != std::string::npos;
+        arg = replace_all(replace_all(arg, "{big}", out + "/big.txt"), "{out}", out);
+        for (size_t at = 0; at < arg.size();)
+        {
+            size_t end = arg.find(' ', at);
+            if (end == std::string::npos)
+                end = arg.size();
+            t.argv.push_back(arg.substr(at, end - at));
+            at = end + 1;
+        }
+        t.argv[0] = bindir + "/" + t.argv[0];
+    }
+    else if (op == "type")
+    {
+        // One key per UTF-8 character.
+        std::string text = unescape(arg);
+        for (size_t i = 0; i < text.size();)
+        {
+            size_t n = 1;
+            while (i + n < text.size() && (static_cast<unsigned char>(text[i + n]) & 0xc0) == 0x80)
+                n++;
+            t.keys.push_back(text.substr(i, n));
+            i += n;
+        }
+    }
+    else if (op == "key")
+        t.keys.push_back(unescape(arg));
+    else if (op == "paste")
+        t.keys.push_back("\x1b[200~" + unescape(arg) + "\x1b[201~");
+    else if (op == "repeat")
+    {
+        size_t rest = arg.find(' ');
+        int n = std::atoi(arg.c_str());
+        for (int i = 0; i < n && rest != std::string::npos; ++i)
+        {
+            if (!add_event(t, arg.substr(rest + 1), bindir, out))
+                return false;
+        }
+    }
+    else
+        return false;
+    return true;
+}
+
+static bool load(const std::string& path, Transcript& t, const std::string& bindir, const std::string& out)
+{
+    FILE* f = std::fopen(path.c_str(), "r");
+    if (!f)
+        return false;
+    char buf[8192];
+    bool ok = true;
+    while (ok && std::fgets(buf, sizeof buf, f))
+    {
+        std::string line(buf);
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        ok = add_event(t, line, bindir, out);
+        if (!ok)
+            std::fprintf(stderr, "%s: bad line: %s\n", path.c_str(), line.c_str());
+    }
+    std::fclose(f);
+    return ok && !t.argv.empty();
+}
+
+// A 100k-line file, one line in ten with non-ASCII text.
+static void write_big(const std::string& path)
+{
+    std::string s;
+    char line[128];
+    for (int i = 0; i < BIG_LINES; ++i)
+    {
+        const char* text = i % 10 == 7 ? "naïve café, 日本語のテキスト, ελληνικά"
+                                       : "the quick brown fox jumps over the lazy dog";
+        std::snprintf(line, sizeof line, "%06d %s\n", i, text);
+        s += line;
+    }
+    FD fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    write_all(fd.get(), s.data(), s.size());
+}
+
+struct Result
+{
+    size_t keys{0};
+    double p50{0}, p90{0}, p99{0}, max{0};
+    double bytes{0}; // per key
+    double calls{0}; // per key
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = static_cast<size_t>(p / 100 * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Runs t once; false if the program could not be started or got stuck.
+static bool run(const Transcript& t, const std::vector<std::string>& env, const std::string& out, bool counting,
+                std::vector<double>& times, Result& r, Session& s)
+{
+    if (t.big)
+        write_big(out + "/big.txt");
+    unlink((out + "/history").c_str());
+    if (!s.start(t.argv, env, counting))
+        return false;
+    for (const std::string& k : t.keys)
+    {
+        if (s.exited)
+            break;
+        double us;
+        if (!s.key(k, us))
+            return false;
+        times.push_back(us);
+        r.bytes += static_cast<double>(s.bytes);
+        r.calls += static_cast<double>(s.calls);
+    }
+    s.stop();
+    return true;
+}
+
+static std::map<std::string, Result> read_results(const std::string& path)
+{
+    std::map<std::string, Result> m;
+    FILE* f = std::fopen(path.c_str(), "r");
+    if (!f)
+        return m;
+    char name[256];
+    Result r;
+    char buf[512];
+    while (std::fgets(buf, sizeof buf, f))
+    {
+        if (buf[0] != '#' && std::sscanf(buf, "%255s %zu %lf %lf %lf %lf %lf %lf", name, &r.keys, &r.p50, &r.p90,
+                                         &r.p99, &r.max, &r.bytes, &r.calls) == 8)
+            m[name] = r;
+    }
+    std::fclose(f);
+    return m;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::fprintf(stderr, "usage: %s <bindir> <transcript dir> <out dir> [<baseline>]\n", argv[0]);
+        return 2;
+    }
+    std::string bindir = argv[1];
+    std::string out = argv[3];
+    if (bindir[0] != '/')
+        bindir = std::string(getcwd(nullptr, 0)) + "/" + bindir;
+    if (out[0] != '/')
+        out = std::string(getcwd(nullptr, 0)) + "/" + out;
+    mkdir(out.c_str(), 0755);
+    mkdir((out + "/home").c_str(), 0755);
+
+    std::vector<std::string> names;
+    if (DIR* d = opendir(argv[2]))
+    {
+        while (dirent* e = readdir(d))
+        {
+            std::string n = e->d_name;
+            if (n.size() > 5 && n.compare(n.size() - 5, 5, ".keys") == 0)
+                names.push_back(n.substr(0, n.size() - 5));
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::string> env = {"TERM=xterm-256color", "HOME=" + out + "/home", "HISTFILE=" + out + "/history"};
+    if (const char* path = getenv("PATH"))
+        env.push_back(std::string("PATH=") + path);
+
+    std::printf("%-16s %6s %8s %8s %8s %8s %10s %9s\n", "transcript", "keys", "p50 us", "p90 us", "p99 us", "max us",
+                "bytes/key", "calls/key");
+    std::map<std::string, Result> results;
+    std::vector<std::string> mixes;
+    for (const std::string& name : names)
+    {
+        Transcript t;
+        t.name = name;
+        if (!load(std::string(argv[2]) + "/" + name + ".keys", t, bindir, out))
+            return 1;
+
+        Result r;
+        std::vector<double> times;
+        bool ok = true;
+        for (int i = 0; i < RUNS && ok; ++i)
+        {
+            Session s;
+            Result ignored;
+            ok = run(t, env, out, false, times, ignored, s);
+        }
+        std::vector<double> counted;
+        Session s;
+        ok = ok && run(t, env, out, true, counted, r, s);
+        if (!ok || times.empty())
+        {
+            std::fprintf(stderr, "%s: program did not start or got stuck\n", name.c_str());
+            return 1;
+        }
+        FD fd(open((out + "/" + name + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        write_all(fd.get(), s.output.data(), s.output.size());
+
+        std::sort(times.begin(), times.end());
+        r.keys = counted.size();
+        r.p50 = percentile(times, 50);
+        r.p90 = percentile(times, 90);
+        r.p99 = percentile(times, 99);
+        r.max = times.back();
+        r.bytes /= static_cast<double>(r.keys);
+        r.calls /= static_cast<double>(r.keys);
+        results[name] = r;
+        std::printf("%-16s %6zu %8.1f %8.1f %8.1f %8.1f %10.1f %9.2f\n", name.c_str(), r.keys, r.p50, r.p90, r.p99,
+                    r.max, r.bytes, r.calls);
+
+        // The system calls behind calls/key, most frequent first.
+        std::vector<std::pair<size_t, long>> by_count;
+        for (const auto& [nr, n] : s.mix)
+            by_count.push_back({n, nr});
+        std::sort(by_count.rbegin(), by_count.rend());
+        std::string mix = name + ":";
+        char buf[64];
+        for (size_t i = 0; i < by_count.size() && i < 8; ++i)
+        {
+            std::snprintf(buf, sizeof buf, " %s %.2f", call_name(by_count[i].second).c_str(),
+                          static_cast<double>(by_count[i].first) / static_cast<double>(r.keys));
+            mix += buf;
+        }
+        mixes.push_back(mix);
+    }
+    std::printf("\ncalls per key\n");
+    for (const std::string& m : mixes)
+        std::printf("  %s\n", m.c_str());
+
+    FILE* f = std::fopen((out + "/results.txt").c_str(), "w");
+    if (!f)
+    {
+        std::perror(out.c_str());
+        return 1;
+    }
+    std::fprintf(f, "# transcript keys p50_us p90_us p99_us max_us bytes_per_key calls_per_key\n");
+    for (const auto& [name, r] : results)
+        std::fprintf(f, "%s %zu %.1f %.1f %.1f %.1f %.1f %.2f\n", name.c_str(), r.keys, r.p50, r.p90, r.p99, r.max,
+                     r.bytes, r.calls);
+    std::fclose(f);
+
+    if (argc < 5)
+        return 0;
+    int status = 0;
+    for (const auto& [name, base] : read_results(argv[4]))
+    {
+        auto it = results.find(name);
+        if (it == results.end())
+            continue;
+        const Result& r = it->second;
+        auto check = [&](const char* what, double now, double was, double limit) {
+            if (now <= limit)
+                return;
+            std::printf("REGRESSION %s %s: %.2f, baseline %.2f\n", name.c_str(), what, now, was);
+            status = 1;
+        };
+        check("bytes/key", r.bytes, base.bytes, base.bytes * (1 + COUNT_SLACK) + 0.5);
+        check("calls/key", r.calls, base.calls, base.calls * (1 + COUNT_SLACK) + 0.05);
+        check("p50 us", r.p50, base.p50, base.p50 * LATENCY_SLACK);
+    }
+    std::printf("%s against %s\n", status ? "FAILED" : "passed", argv[4]);
+    return status;
+}
@@ -0,0 +1,172 @@
+// Throughput of the scanning kernels (src/include/scan.hpp) and of the
+// applets built on them.
+//
+//   scan <megabytes> <bindir> [<tool dir>]
+//
+// Kernels run at every level the CPU supports over an in-memory, log-like
+// buffer; the searches look for something absent, so each call scans the
+// whole buffer. glibc memchr/memmem are the reference. The applets then
+// process the same data from a file in bench/out (page cache warm),
+// optionally next to the same commands from <tool dir>, e.g. /usr/bin.
+// Output goes to /dev/null, which GNU grep notices and stops at the first
+// match for plain searches. Best of 5, in GB/s.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/scan.hpp"
+#include "../src/include/util.hpp"
+
+extern char** environ;
+
+constexpr int RUNS = 5;
+
+static double now_s()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+template <typename F> static double best_gbps(size_t bytes, F&& fn)
+{
+    double best = 1e30;
+    for (int i = 0; i < RUNS; ++i)
+    {
+        double t0 = now_s();
+        fn();
+        best = std::min(best, now_s() - t0);
+    }
+    return static_cast<double>(bytes) / best / 1e9;
+}
+
+static std::string make_log(size_t bytes)
+{
+    const char* words[] = {"GET", "POST", "/api/v1/users", "error", "200", "404", "user=alice", "latency_ms=12", "ok"};
+    std::string s;
+    s.reserve(bytes + 256);
+    unsigned seed = 1;
+    while (s.size() < bytes)
+    {
+        int n = static_cast<int>((seed = seed * 1103515245 + 12345) >> 16) % 14;
+        for (int i = 0; i < n; ++i)
+        {
+            s += words[((seed = seed * 1103515245 + 12345) >> 16) % 9];
+            s += ' ';
+        }
+        s += '\n';
+    }
+    s.resize(bytes);
+    return s;
+}
+
+static double run_tool(const std::string& path, std::vector<std::string> args, const char* file)
+{
+    std::vector<char*> argv{const_cast<char*>(path.c_str())};
+    for (std::string& a : args)
+        argv.push_back(a.data());
+    argv.push_back(const_cast<char*>(file));
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    double best = 1e30;
+    for (int i = 0; i < RUNS; ++i)
+    {
+        double t0 = now_s();
+        pid_t pid;
+        if (posix_spawn(&pid, path.c_str(), &fa, nullptr, argv.data(), environ) != 0)
+            return 0;
+        int status;
+        waitpid(pid, &status, 0);
+        best = std::min(best, now_s() - t0);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "usage: %s <megabytes> <bindir> [<tool dir>]\n", argv[0]);
+        return 2;
+    }
+    size_t bytes = static_cast<size_t>(std::atol(argv[1])) << 20;
+    std::string data = make_log(bytes);
+    const char* b = data.data();
+    const char* e = b + data.size();
+    volatile size_t sink = 0;
+
+    std::printf("%-22s %8s\n", "kernel", "GB/s");
+    std::printf("%-22s %8.2f\n", "glibc memchr",
+                best_gbps(bytes, [&] { sink = sink + (memchr(b, '\x01', bytes) != nullptr); }));
+    std::printf("%-22s %8.2f\n", "glibc memmem",
+                best_gbps(bytes, [&] { sink = sink + (memmem(b, bytes, "timeout", 7) != nullptr); }));
+    for (int l = static_cast<int>(scan::detect()); l >= 0; --l)
+    {
+        auto level = static_cast<scan::Level>(l);
+        scan::set_level(level);
+        std::string tag = std::string(" ") + scan::level_name(level);
+        auto row = [&](const char* name, double gbps) { std::printf("%-22s %8.2f\n", (name + tag).c_str(), gbps); };
+        row("count_byte", best_gbps(bytes, [&] { sink = sink + scan::count_byte(b, bytes, '\n'); }));
+        row("find_byte", best_gbps(bytes, [&] { sink = sink + (scan::find_byte(b, e, '\x01') - b); }));
+        row("find_special", best_gbps(bytes, [&] {
+                for (const char* p = b; p < e; p = scan::find_special(p, e) + 1)
+                    sink = sink + 1;
+            }));
+        row("count_words", best_gbps(bytes, [&] {
+                bool in_word = false;
+                sink = sink + scan::count_words(b, bytes, in_word);
+            }));
+        row("find_substr", best_gbps(bytes, [&] { sink = sink + (scan::find_substr(b, e, "timeout") - b); }));
+        row("find_substr -i", best_gbps(bytes, [&] { sink = sink + (scan::find_substr(b, e, "Timeout", true) - b); }));
+    }
+
+    const char* file = "bench/out/scan.log";
+    {
+        FD fd(open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        write_all(fd.get(), data.data(), data.size());
+    }
+    struct Case
+    {
+        const char* tool;
+        std::vector<std::string> args;
+    };
+    const Case cases[] = {
+        {"wc", {"-l"}},
+        {"wc", {}},
+        {"grep", {"timeout"}},
+        {"grep", {"-c", "error"}},
+        {"grep", {"-i", "TIMEOUT"}},
+        {"grep", {"^POST.*404$"}},
+        {"cat", {"-n"}},
+        {"cat", {"-A"}},
+    };
+    std::printf("\n%-26s %10s %10s\n", "applet", "GB/s", argc > 3 ? "reference" : "");
+    for (const Case& c : cases)
+    {
+        std::string label = c.tool;
+        for (const std::string& a : c.args)
+            label += " " + a;
+        double t = run_tool(std::string(argv[2]) + "/" + c.tool, c.args, file);
+        std::printf("%-26s %10.2f", label.c_str(), t > 0 ? static_cast<double>(bytes) / t / 1e9 : 0.0);
+        if (argc > 3)
+        {
+            double r = run_tool(std::string(argv[3]) + "/" + c.tool, c.args, file);
+            std::printf(" %10.2f", r > 0 ? static_cast<double>(bytes) / r / 1e9 : 0.0);
+        }
+        std::printf("\n");
+    }
+    unlink(file);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Exec-to-exit latency and file size of the simple applets.
+//
+//   startup <iterations> <bindir>...
+//
+// Each applet is spawned <iterations> times with stdout/stderr on /dev/null
+// and timed from posix_spawn to waitpid with CLOCK_MONOTONIC.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char** environ;
+
+struct Case
+{
+    const char* applet;
+    std::vector<std::string> args;
+};
+
+static double now_us()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) * 1e6 + static_cast<double>(ts.tv_nsec) / 1e3;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <iterations> <bindir>...\n", argv[0]);
+        return 2;
+    }
+    int iterations = atoi(argv[1]);
+
+    char scratch[] = "/tmp/startupXXXXXX";
+    if (!mkdtemp(scratch))
+        return 1;
+    std::string dir = scratch;
+
+    const Case cases[] = {
+        {"cat", {"/dev/null"}},
+        {"ls", {"/"}},
+        {"mkdir", {dir}}, // exists: the error path
+        {"touch", {dir + "/file"}},
+        {"rm", {dir + "/missing"}},
+    };
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&fa, 1, 2);
+
+    printf("%-32s %10s %10s %10s\n", "binary", "bytes", "median us", "p99 us");
+    for (int d = 2; d < argc; ++d)
+    {
+        for (const Case& c : cases)
+        {
+            std::string path = std::string(argv[d]) + "/" + c.applet;
+            struct stat st{};
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+
+            std::vector<char*> av{const_cast<char*>(path.c_str())};
+            for (const std::string& a : c.args)
+                av.push_back(const_cast<char*>(a.c_str()));
+            av.push_back(nullptr);
+
+            std::vector<double> samples;
+            samples.reserve(static_cast<size_t>(iterations));
+            for (int i = 0; i < iterations; ++i)
+            {
+                double t0 = now_us();
+                pid_t pid;
+                if (posix_spawn(&pid, path.c_str(), &fa, nullptr, av.data(), environ) != 0)
+                    return 1;
+                int status;
+                waitpid(pid, &status, 0);
+                samples.push_back(now_us() - t0);
+            }
+            std::sort(samples.begin(), samples.end());
+            printf("%-32s %10lld %10.1f %10.1f\n", path.c_str(), static_cast<long long>(st.st_size),
+                   samples[samples.size() / 2], samples[samples.size() * 99 / 100]);
+        }
+    }
+
+    unlink((dir + "/file").c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
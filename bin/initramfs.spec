@@ -0,0 +1,28 @@
+# Contents of init.cpio, read by tools/mkinitramfs (gen_init_cpio syntax).
+# Locations are relative to the top-level directory; LUA and VIM binaries
+# are appended by the Makefile when set.
+
+dir /dev 0755 0 0
+nod /dev/console 0600 0 0 c 5 1
+
+file /init bin/init 0755 0 0
+file /cat bin/cat 0755 0 0
+file /edit bin/edit 0755 0 0
+file /ls bin/ls 0755 0 0
+file /mkdir bin/mkdir 0755 0 0
+file /touch bin/touch 0755 0 0
+file /rm bin/rm 0755 0 0
+file /cp bin/cp 0755 0 0
+file /mv bin/mv 0755 0 0
+file /wc bin/wc 0755 0 0
+file /grep bin/grep 0755 0 0
+
+dir /etc 0755 0 0
+dir /etc/init.d 0755 0 0
+file /etc/init.d/dev rootfs/etc/init.d/dev 0644 0 0
+file /etc/init.d/devpts rootfs/etc/init.d/devpts 0644 0 0
+file /etc/init.d/proc rootfs/etc/init.d/proc 0644 0 0
+file /etc/init.d/run rootfs/etc/init.d/run 0644 0 0
+file /etc/init.d/run-lock rootfs/etc/init.d/run-lock 0644 0 0
+file /etc/init.d/sys rootfs/etc/init.d/sys 0644 0 0
+file /etc/init.d/tmp rootfs/etc/init.d/tmp 0644 0 0
@@ -6,73 +6,376 @@
 #include <unistd.h>
 #include <vector>
 
+#include "include/scan.hpp"
+#include "include/uring.hpp"
 #include "include/util.hpp"
 
-constexpr size_t PREALLOC_BUFFER_SIZE = 4096;
+constexpr size_t PREALLOC_BUFFER_SIZE = 128 * 1024;
+constexpr size_t URING_SLOTS = 32;             // operands in flight
+constexpr size_t URING_SLOT_BUFFER = 64 * 1024; // both reads of each
+constexpr unsigned URING_FIRST_READ = 60 * 1024;
+constexpr unsigned URING_SUBMIT_BATCH = 16;
+constexpr size_t LINE_NUMBER_WIDTH = 6;
 
-static bool cat_fd(int fd, std::string_view name, std::vector<char>& buffer)
+// -n numbers lines, -A shows controls as ^X, non-ASCII as M-, and line ends
+// as $. Line state carries across reads and files.
+struct Format
 {
-    if (fd < 0)
-        return false;
+    bool number{false};
+    bool show_all{false};
+    bool line_start{true};
+    size_t line_no{0};
+    std::vector<char> out{};
 
-    struct stat st{};
-    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode))
+    bool enabled() const
+    {
+        return number || show_all;
+    }
+
+    void append(const char* p, size_t n)
+    {
+        out.insert(out.end(), p, p + n);
+    }
+
+    void append_number()
+    {
+        char digits[24];
+        size_t n = 0;
+        for (size_t v = ++line_no; v; v /= 10)
+            digits[n++] = static_cast<char>('0' + v % 10);
+        for (size_t i = n; i < LINE_NUMBER_WIDTH; ++i)
+            out.push_back(' ');
+        while (n)
+            out.push_back(digits[--n]);
+        out.push_back('\t');
+        line_start = false;
+    }
+
+    void append_visible(unsigned char c)
+    {
+        if (c == '\n')
+        {
+            append("$\n", 2);
+            line_start = true;
+            return;
+        }
+        if (c >= 0x80)
+        {
+            append("M-", 2);
+            c -= 0x80;
+        }
+        if (c < 0x20 || c == 0x7f)
+        {
+            out.push_back('^');
+            out.push_back(c == 0x7f ? '?' : static_cast<char>(c + 64));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(c));
+        }
+    }
+
+    // Rewrites one read into out, jumping between newlines (-n) or special
+    // bytes (-A) with the SIMD scanners.
+    void feed(const char* p, const char* end)
+    {
+        while (p < end)
+        {
+            if (line_start && number)
+                append_number();
+            if (!show_all)
+            {
+                const char* nl = scan::find_byte(p, end, '\n');
+                const char* stop = nl < end ? nl + 1 : end;
+                append(p, static_cast<size_t>(stop - p));
+                line_start = nl < end;
+                p = stop;
+                continue;
+            }
+            const char* special = scan::find_special(p, end);
+            append(p, static_cast<size_t>(special - p));
+            if (special == end)
+                break;
+            append_visible(static_cast<unsigned char>(*special));
+            p = special + 1;
+        }
+    }
+};
+
+static void report(const char* what, std::string_view name, const char* reason)
+{
+    print_error("cat: ");
+    print_error(what);
+    print_error("'");
+    print_error(name);
+    print_error("': ");
+    print_error(reason);
+    print_error("\r\n");
+}
+
+// Writes one read, rewritten first for -n/-A.
+static bool emit(const char* data, size_t len, Format& fmt)
+{
+    if (fmt.enabled())
     {
-        print_error("cat: '");
-        print_error(name);
-        print_error("': Is a directory\r\n");
+        fmt.out.clear();
+        fmt.feed(data, data + len);
+        data = fmt.out.data();
+        len = fmt.out.size();
+    }
+    if (!write_all(STDOUT_FILENO, data, len))
+    {
+        print_error("cat: write error: ");
+        print_error(strerror(errno));
+        print_error("\r\n");
         return false;
     }
+    return true;
+}
 
+// Copies fd from its current position to EOF.
+static bool cat_stream(int fd, std::string_view name, std::vector<char>& buffer, Format& fmt)
+{
     if (buffer.empty())
         buffer.resize(PREALLOC_BUFFER_SIZE);
 
-    bool ok = true;
     while (true)
     {
         ssize_t r = read(fd, buffer.data(), buffer.size());
         if (r == 0)
-            break; // EOF
+            return true; // EOF
         if (r < 0)
         {
             if (errno == EINTR)
                 continue;
-            print_error("cat: error reading '");
-            print_error(name);
-            print_error("': ");
-            print_error(strerror(errno));
-            print_error("\r\n");
-            ok = false;
-            break;
-        }
-        if (!write_all(STDOUT_FILENO, buffer.data(), static_cast<size_t>(r)))
-        {
-            print_error("cat: write error: ");
-            print_error(strerror(errno));
-            print_error("\r\n");
-            ok = false;
-            break;
+            report("error reading ", name, strerror(errno));
+            return false;
         }
+        if (!emit(buffer.data(), static_cast<size_t>(r), fmt))
+            return false;
+    }
+}
+
+static bool cat_fd(int fd, std::string_view name, std::vector<char>& buffer, Format& fmt)
+{
+    if (fd < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        report("", name, "Is a directory");
+        return false;
     }
-    return ok;
+    return cat_stream(fd, name, buffer, fmt);
 }
 
-static bool cat_file(std::string_view path, std::vector<char>& buffer)
+static bool cat_file(std::string_view path, std::vector<char>& buffer, Format& fmt)
 {
     if (path == "-")
-        return cat_fd(STDIN_FILENO, path, buffer);
+        return cat_fd(STDIN_FILENO, path, buffer, fmt);
 
     FD fd(open(path.data(), O_RDONLY | O_CLOEXEC));
     if (!fd)
     {
-        print_error("cat: cannot open '");
-        print_error(path);
-        print_error("': ");
-        print_error(strerror(errno));
-        print_error("\r\n");
+        report("cannot open ", path, strerror(errno));
         return false;
     }
-    return cat_fd(fd.get(), path, buffer);
+    return cat_fd(fd.get(), path, buffer, fmt);
+}
+
+// One operand on its way through the ring. Once the open completes, two
+// reads at the file position are queued as a hard link, so the second runs
+// even after a short first one: it returning 0 proves EOF for any kind of
+// file without a stat. The first read is written as soon as it is in: on a
+// FIFO or terminal the second one waits for the writer to send more.
+struct Slot
+{
+    std::string_view name{};
+    unsigned pending{0}; // operations in flight
+    int fd{-1};
+    int open_error{0};
+    bool read_done{false};
+    long got{0};   // first read: bytes or -errno
+    long probe{0}; // second read
+    std::vector<char> buf{};
+};
+
+// Keeps the next URING_SLOTS operands opened and read while the current one
+// is written, so a small file costs no system calls of its own: opens, reads
+// and closes go through a few batched io_uring_enter calls. Output and error
+// messages stay in operand order; anything past the two reads continues with
+// cat_stream. "-" is read in place when its turn comes.
+class Prefetch
+{
+  public:
+    explicit Prefetch(const std::vector<std::string_view>& operands) : files(operands)
+    {
+    }
+
+    bool init()
+    {
+        // A slot has at most three operations queued or in flight (a close
+        // beside an open, or two reads), so neither queue can fill up.
+        if (!ring.init(4 * URING_SLOTS))
+            return false;
+        slots.resize(files.size() < URING_SLOTS ? files.size() : URING_SLOTS);
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            slots[i].buf.resize(URING_SLOT_BUFFER);
+            start(i, i);
+        }
+        return true;
+    }
+
+    // Writes operand i, which must come right after the previous call's.
+    // Returns -1 if the ring failed; the caller goes on without it.
+    int cat(size_t i, std::vector<char>& buffer, Format& fmt)
+    {
+        size_t k = i % slots.size();
+        if (!wait(slots[k], false))
+            return -1;
+        bool ok = finish(k, buffer, fmt);
+        if (i + slots.size() < files.size())
+            start(k, i + slots.size());
+        if (ring.queued() >= URING_SUBMIT_BATCH)
+            ring.submit(0);
+        return ok ? 1 : 0;
+    }
+
+  private:
+    enum Op : uint64_t
+    {
+        OPEN,
+        READ,
+        PROBE,
+        CLOSE,
+    };
+
+    const std::vector<std::string_view>& files;
+    std::vector<Slot> slots{};
+    Ring ring{};
+
+    void start(size_t k, size_t operand)
+    {
+        Slot& s = slots[k];
+        s.name = files[operand];
+        s.fd = -1;
+        s.open_error = 0;
+        s.read_done = false;
+        s.got = s.probe = 0;
+        if (s.name == "-")
+            return;
+        prep_openat(ring.get(), s.name.data(), O_RDONLY | O_CLOEXEC, k << 2 | OPEN);
+        s.pending = 1;
+    }
+
+    void complete(const io_uring_cqe& c)
+    {
+        uint64_t k = c.user_data >> 2;
+        Slot& s = slots[k];
+        switch (c.user_data & 3)
+        {
+        case OPEN:
+            if (c.res < 0)
+            {
+                s.open_error = -c.res;
+                break;
+            }
+            s.fd = c.res;
+            {
+                io_uring_sqe* e = ring.get();
+                prep_read(e, s.fd, s.buf.data(), URING_FIRST_READ, ~uint64_t{0}, k << 2 | READ);
+                e->flags |= IOSQE_IO_HARDLINK;
+                prep_read(ring.get(), s.fd, s.buf.data() + URING_FIRST_READ,
+                          static_cast<unsigned>(s.buf.size() - URING_FIRST_READ), ~uint64_t{0}, k << 2 | PROBE);
+            }
+            s.pending += 2;
+            break;
+        case READ:
+            s.got = c.res;
+            s.read_done = true;
+            break;
+        case PROBE:
+            s.probe = c.res;
+            break;
+        default:
+            return; // closes are not waited for
+        }
+        s.pending--;
+    }
+
+    // Runs the ring until s has nothing in flight or, unless all is set,
+    // until its first read is in.
+    bool wait(Slot& s, bool all)
+    {
+        while (true)
+        {
+            while (const io_uring_cqe* c = ring.peek())
+            {
+                complete(*c);
+                ring.seen();
+            }
+            if (!s.pending || (!all && s.read_done))
+                return true;
+            if (ring.submit(1) != 0)
+                return false;
+        }
+    }
+
+    bool finish(size_t k, std::vector<char>& buffer, Format& fmt)
+    {
+        Slot& s = slots[k];
+        if (s.name == "-")
+            return cat_fd(STDIN_FILENO, s.name, buffer, fmt);
+        if (s.open_error)
+        {
+            report("cannot open ", s.name, strerror(s.open_error));
+            return false;
+        }
+        bool ok = output(s, buffer, fmt);
+        prep_close(ring.get(), s.fd, k << 2 | CLOSE);
+        s.fd = -1;
+        return ok;
+    }
+
+    bool output(Slot& s, std::vector<char>& buffer, Format& fmt)
+    {
+        bool written = s.got <= 0 || emit(s.buf.data(), static_cast<size_t>(s.got), fmt);
+        // The probe still fills the slot's buffer, so it is waited for even
+        // after a failed write.
+        if (!wait(s, true))
+            s.probe = -EIO;
+        if (!written)
+            return false;
+        if (s.got == -EISDIR)
+        {
+            report("", s.name, "Is a directory");
+            return false;
+        }
+        long err = s.got < 0 ? s.got : s.probe < 0 ? s.probe : 0;
+        if (err)
+        {
+            report("error reading ", s.name, strerror(static_cast<int>(-err)));
+            return false;
+        }
+        if (s.probe == 0)
+            return true;
+        return emit(s.buf.data() + URING_FIRST_READ, static_cast<size_t>(s.probe), fmt) &&
+               cat_stream(s.fd, s.name, buffer, fmt);
+    }
+};
+
+// CAT_URING=0 forces the sequential path. crt has no getenv, so environ is
+// searched directly.
+static bool uring_enabled()
+{
+    for (char** e = environ; e && *e; ++e)
+    {
+        if (std::string_view(*e) == "CAT_URING=0")
+            return false;
+    }
+    return true;
 }
 
 int main(int argc, const char** argv)
@@ -81,15 +384,53 @@ int main(int argc, const char** argv)
     std::vector<char> buffer;
     buffer.reserve(PREALLOC_BUFFER_SIZE);
 
-    if (args.size() == 1)
+    Format fmt;
+    std::vector<std::string_view> files;
+    for (size_t i = 1; i < args.size(); ++i)
     {
-        return cat_fd(STDIN_FILENO, "-", buffer) ? 0 : 1;
+        std::string_view a = args[i];
+        if (a.size() < 2 || a[0] != '-' || !files.empty())
+        {
+            files.push_back(a);
+            continue;
+        }
+        for (char f : a.substr(1))
+        {
+            if (f == 'n')
+                fmt.number = true;
+            else if (f == 'A')
+                fmt.show_all = true;
+            else
+            {
+                print_error("cat: unknown option '");
+                print_error(a);
+                print_error("'\r\n");
+                return 1;
+            }
+        }
+    }
+
+    if (files.empty())
+    {
+        return cat_fd(STDIN_FILENO, "-", buffer, fmt) ? 0 : 1;
     }
 
     bool all_ok = true;
-    for (size_t i = 1; i < args.size(); ++i)
+    size_t i = 0;
+    Prefetch prefetch(files);
+    if (files.size() > 1 && uring_enabled() && prefetch.init())
+    {
+        for (; i < files.size(); ++i)
+        {
+            int r = prefetch.cat(i, buffer, fmt);
+            if (r < 0)
+                break;
+            all_ok = all_ok && r;
+        }
+    }
+    for (; i < files.size(); ++i)
     {
-        if (!cat_file(args[i], buffer))
+        if (!cat_file(files[i], buffer, fmt))
             all_ok = false;
     }
     return all_ok ? 0 : 1;
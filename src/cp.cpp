@@ -0,0 +1,155 @@
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "include/copy.hpp"
+#include "include/util.hpp"
+
+// cp [-r] [-p] [-j threads] source... dest
+struct Options
+{
+    bool recursive{false};
+    bool preserve{false};
+    unsigned threads{0};
+    std::vector<std::string_view> operands{};
+};
+
+static bool parse_options(std::string_view prog, const std::vector<std::string_view>& args, Options& opt)
+{
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        std::string_view a = args[i];
+        if (a.size() < 2 || a[0] != '-' || !opt.operands.empty())
+        {
+            opt.operands.push_back(a);
+            continue;
+        }
+        for (size_t j = 1; j < a.size(); ++j)
+        {
+            if (a[j] == 'r' || a[j] == 'R')
+                opt.recursive = true;
+            else if (a[j] == 'p')
+                opt.preserve = true;
+            else if (a[j] == 'j' && j + 1 < a.size())
+            {
+                opt.threads = static_cast<unsigned>(std::atoi(a.data() + j + 1));
+                break;
+            }
+            else if (a[j] == 'j' && i + 1 < args.size())
+            {
+                opt.threads = static_cast<unsigned>(std::atoi(args[++i].data()));
+                break;
+            }
+            else
+            {
+                print_error("ERROR: ");
+                print_error(prog);
+                print_error(": unknown option '");
+                print_error(a);
+                print_error("'\r\n");
+                return false;
+            }
+        }
+    }
+    if (opt.threads == 0)
+        opt.threads = opt.recursive ? CopyPool::default_threads() : 1;
+    return require_args(prog, opt.operands.size(), 2, "usage: cp [-r] [-p] [-j threads] source... dest");
+}
+
+static void print_failure(std::string_view prog, std::string_view a, std::string_view msg, std::string_view b = {})
+{
+    print_error("ERROR: ");
+    print_error(prog);
+    print_error(": '");
+    print_error(a);
+    print_error("'");
+    if (!b.empty())
+    {
+        print_error(" and '");
+        print_error(b);
+        print_error("'");
+    }
+    print_error(msg);
+    print_error("\r\n");
+}
+
+// True if dst lies inside the directory src (cp -r a a/b would never end).
+static bool inside(const std::string& src, const std::string& dst)
+{
+    char* s = realpath(src.c_str(), nullptr);
+    size_t slash = dst.find_last_of('/');
+    std::string parent = slash == std::string::npos ? "." : slash == 0 ? "/" : dst.substr(0, slash);
+    char* d = realpath(parent.c_str(), nullptr);
+    bool in = false;
+    if (s && d)
+    {
+        std::string from = std::string(s) + "/", to = std::string(d) + "/";
+        in = to.compare(0, from.size(), from) == 0;
+    }
+    free(s);
+    free(d);
+    return in;
+}
+
+int32_t main(int32_t argc, char* argv[])
+{
+    auto args = make_args(argc, argv);
+    auto prog = prog_name(args[0]);
+
+    Options opt;
+    if (!parse_options(prog, args, opt))
+        return 1;
+
+    std::string dest(opt.operands.back());
+    opt.operands.pop_back();
+    struct stat dest_st{};
+    bool dest_exists = stat(dest.c_str(), &dest_st) == 0;
+    bool into_dir = dest_exists && S_ISDIR(dest_st.st_mode);
+    if (opt.operands.size() > 1 && !into_dir)
+    {
+        print_failure(prog, dest, " is not a directory");
+        return 1;
+    }
+
+    CopyPool pool(prog, opt.threads, opt.preserve);
+    bool ok = true;
+    for (std::string_view operand : opt.operands)
+    {
+        std::string src(operand);
+        std::string dst = into_dir ? join_path(dest, base_name(src)) : dest;
+
+        // Top-level symlinks are followed unless copying a tree.
+        struct stat st{};
+        if ((opt.recursive ? lstat(src.c_str(), &st) : stat(src.c_str(), &st)) != 0)
+        {
+            print_errno(prog, "stat", src);
+            ok = false;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode) && !opt.recursive)
+        {
+            print_failure(prog, src, " is a directory (not copied without -r)");
+            ok = false;
+            continue;
+        }
+        struct stat dst_st{};
+        if (stat(dst.c_str(), &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino)
+        {
+            print_failure(prog, src, " are the same file", dst);
+            ok = false;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode) && inside(src, dst))
+        {
+            print_failure(prog, src, " cannot be copied into itself");
+            ok = false;
+            continue;
+        }
+        if (!pool.copy(src, dst, st))
+            ok = false;
+    }
+    return pool.finish() && ok ? 0 : 1;
+}
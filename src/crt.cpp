@@ -0,0 +1,401 @@
+// Minimal runtime for the freestanding applets (make freestanding). It
+// supplies _start and exactly the libc/libstdc++ symbols cat, ls, mkdir,
+// touch and rm link against, all on top of include/syscall.hpp. No TLS,
+// locale, stdio or atexit machinery: main's return value goes straight to
+// exit_group. Memory is bumped out of mmap'd chunks and never returned.
+//
+// No libc headers are included here; the declarations the applets see come
+// from glibc, and the x86-64 ABI types below match them.
+
+#include "include/syscall.hpp"
+
+namespace
+{
+
+constexpr int OPEN_RDONLY = 0;
+constexpr int OPEN_DIRECTORY = 0200000;
+constexpr int OPEN_CLOEXEC = 02000000;
+constexpr int REMOVE_DIR = 0x200;
+constexpr int PROT_RW = 0x1 | 0x2;
+constexpr int MAP_PRIVATE_ANON = 0x02 | 0x20;
+constexpr size_t CHUNK_SIZE = 1u << 20;
+
+int errno_value;
+
+long check(long r)
+{
+    if (r < 0 && r > -4096)
+    {
+        errno_value = static_cast<int>(-r);
+        return -1;
+    }
+    return r;
+}
+
+char* chunk;
+size_t chunk_left;
+
+void* bump(size_t n)
+{
+    n = (n + 15) & ~size_t{15};
+    if (n > CHUNK_SIZE / 4)
+    {
+        auto m = sys::mmap(nullptr, n, PROT_RW, MAP_PRIVATE_ANON, -1, 0);
+        return m ? m.value() : nullptr;
+    }
+    if (n > chunk_left)
+    {
+        auto m = sys::mmap(nullptr, CHUNK_SIZE, PROT_RW, MAP_PRIVATE_ANON, -1, 0);
+        if (!m)
+            return nullptr;
+        chunk = static_cast<char*>(m.value());
+        chunk_left = CHUNK_SIZE;
+    }
+    void* p = chunk;
+    chunk += n;
+    chunk_left -= n;
+    return p;
+}
+
+// Layout of linux_dirent64, which is also glibc's struct dirent on x86-64,
+// so readdir can hand out pointers into the getdents64 buffer.
+struct Dirent
+{
+    uint64_t ino;
+    int64_t off;
+    uint16_t reclen;
+    uint8_t type;
+    char name[1];
+};
+
+struct DirStream
+{
+    int fd;
+    size_t pos;
+    size_t len;
+    alignas(8) char buf[32 * 1024];
+};
+
+struct ErrorName
+{
+    int code;
+    const char* text;
+};
+
+constexpr ErrorName ERRORS[] = {
+    {1, "Operation not permitted"},
+    {2, "No such file or directory"},
+    {4, "Interrupted system call"},
+    {5, "Input/output error"},
+    {9, "Bad file descriptor"},
+    {11, "Resource temporarily unavailable"},
+    {12, "Cannot allocate memory"},
+    {13, "Permission denied"},
+    {14, "Bad address"},
+    {16, "Device or resource busy"},
+    {17, "File exists"},
+    {18, "Invalid cross-device link"},
+    {20, "Not a directory"},
+    {21, "Is a directory"},
+    {22, "Invalid argument"},
+    {24, "Too many open files"},
+    {26, "Text file busy"},
+    {27, "File too large"},
+    {28, "No space left on device"},
+    {30, "Read-only file system"},
+    {31, "Too many links"},
+    {32, "Broken pipe"},
+    {36, "File name too long"},
+    {39, "Directory not empty"},
+    {40, "Too many levels of symbolic links"},
+    {122, "Disk quota exceeded"},
+};
+
+char unknown_error[32];
+
+} // namespace
+
+extern "C"
+{
+
+    int* __errno_location()
+    {
+        return &errno_value;
+    }
+
+    void* memcpy(void* dst, const void* src, size_t n)
+    {
+        void* ret = dst;
+        __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+        return ret;
+    }
+
+    void* memmove(void* dst, const void* src, size_t n)
+    {
+        auto* d = static_cast<unsigned char*>(dst);
+        auto* s = static_cast<const unsigned char*>(src);
+        if (d <= s || d >= s + n)
+            return memcpy(dst, src, n);
+        while (n--)
+            d[n] = s[n];
+        return dst;
+    }
+
+    void* memset(void* dst, int c, size_t n)
+    {
+        void* ret = dst;
+        __asm__ volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+        return ret;
+    }
+
+    int memcmp(const void* a, const void* b, size_t n)
+    {
+        auto* x = static_cast<const unsigned char*>(a);
+        auto* y = static_cast<const unsigned char*>(b);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (x[i] != y[i])
+                return x[i] - y[i];
+        }
+        return 0;
+    }
+
+    size_t strlen(const char* s)
+    {
+        const char* p = s;
+        while (*p)
+            p++;
+        return static_cast<size_t>(p - s);
+    }
+
+    int strcmp(const char* a, const char* b)
+    {
+        while (*a && *a == *b)
+        {
+            a++;
+            b++;
+        }
+        return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+    }
+
+    char* strerror(int code)
+    {
+        for (const ErrorName& e : ERRORS)
+        {
+            if (e.code == code)
+                return const_cast<char*>(e.text);
+        }
+        const char prefix[] = "Unknown error ";
+        char* p = unknown_error;
+        for (char c : prefix)
+            *p++ = c;
+        p--;
+        char digits[12];
+        int n = 0;
+        unsigned v = static_cast<unsigned>(code);
+        do
+        {
+            digits[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v);
+        while (n)
+            *p++ = digits[--n];
+        *p = '\0';
+        return unknown_error;
+    }
+
+    long read(int fd, void* buf, size_t n)
+    {
+        return check(sys::read(fd, buf, n).raw);
+    }
+
+    long write(int fd, const void* buf, size_t n)
+    {
+        return check(sys::write(fd, buf, n).raw);
+    }
+
+    int open(const char* path, int flags, ...)
+    {
+        __builtin_va_list ap;
+        __builtin_va_start(ap, flags);
+        unsigned mode = __builtin_va_arg(ap, unsigned);
+        __builtin_va_end(ap);
+        return static_cast<int>(check(sys::openat(sys::AT_CWD, path, flags, mode).raw));
+    }
+
+    int close(int fd)
+    {
+        return static_cast<int>(check(sys::close(fd).raw));
+    }
+
+    int fstat(int fd, struct stat* st)
+    {
+        return static_cast<int>(check(sys::fstat(fd, st).raw));
+    }
+
+    int mkdir(const char* path, unsigned mode)
+    {
+        return static_cast<int>(check(sys::mkdirat(sys::AT_CWD, path, mode).raw));
+    }
+
+    int unlink(const char* path)
+    {
+        return static_cast<int>(check(sys::unlinkat(sys::AT_CWD, path, 0).raw));
+    }
+
+    int rmdir(const char* path)
+    {
+        return static_cast<int>(check(sys::unlinkat(sys::AT_CWD, path, REMOVE_DIR).raw));
+    }
+
+    long getdents64(int fd, void* buf, size_t n)
+    {
+        return check(sys::getdents64(fd, buf, n).raw);
+    }
+
+    void* opendir(const char* path)
+    {
+        auto fd = sys::openat(sys::AT_CWD, path, OPEN_RDONLY | OPEN_DIRECTORY | OPEN_CLOEXEC);
+        if (!fd)
+        {
+            errno_value = fd.error();
+            return nullptr;
+        }
+        auto* d = static_cast<DirStream*>(bump(sizeof(DirStream)));
+        if (!d)
+        {
+            sys::close(fd.value());
+            errno_value = 12;
+            return nullptr;
+        }
+        d->fd = fd.value();
+        d->pos = d->len = 0;
+        return d;
+    }
+
+    void* readdir(void* stream)
+    {
+        auto* d = static_cast<DirStream*>(stream);
+        if (d->pos >= d->len)
+        {
+            auto n = sys::getdents64(d->fd, d->buf, sizeof d->buf);
+            if (!n || n.value() == 0)
+            {
+                if (!n)
+                    errno_value = n.error();
+                return nullptr;
+            }
+            d->pos = 0;
+            d->len = static_cast<size_t>(n.value());
+        }
+        auto* e = reinterpret_cast<Dirent*>(d->buf + d->pos);
+        d->pos += e->reclen;
+        return e;
+    }
+
+    int closedir(void* stream)
+    {
+        return close(static_cast<DirStream*>(stream)->fd);
+    }
+
+    [[noreturn]] void _exit(int code)
+    {
+        sys::exit_group(code);
+    }
+
+    [[noreturn]] void abort()
+    {
+        sys::exit_group(134);
+    }
+
+    void* malloc(size_t n)
+    {
+        return bump(n);
+    }
+
+    void free(void*)
+    {
+    }
+
+    int main(int argc, char** argv, char** envp);
+
+    // Static constructors are collected by the linker even without crt1.o.
+    extern void (*__init_array_start[])(int, char**, char**);
+    extern void (*__init_array_end[])(int, char**, char**);
+
+    char** environ;
+
+    [[noreturn]] void __crt_start(long* sp)
+    {
+        int argc = static_cast<int>(sp[0]);
+        char** argv = reinterpret_cast<char**>(sp + 1);
+        environ = argv + argc + 1;
+        for (auto** f = __init_array_start; f != __init_array_end; ++f)
+            (*f)(argc, argv, environ);
+        sys::exit_group(main(argc, argv, environ));
+    }
+}
+
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "    xor %ebp, %ebp\n"
+        "    mov %rsp, %rdi\n"
+        "    and $-16, %rsp\n"
+        "    call __crt_start\n"
+        "    hlt\n");
+
+void* operator new(size_t n)
+{
+    void* p = bump(n);
+    if (!p)
+        abort();
+    return p;
+}
+
+void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void*) noexcept
+{
+}
+
+void operator delete[](void*) noexcept
+{
+}
+
+void operator delete(void*, size_t) noexcept
+{
+}
+
+void operator delete[](void*, size_t) noexcept
+{
+}
+
+// libstdc++ containers call these on impossible sizes; without exceptions
+// there is nothing to unwind to.
+namespace std
+{
+[[noreturn]] void __throw_length_error(const char*)
+{
+    abort();
+}
+[[noreturn]] void __throw_bad_alloc()
+{
+    abort();
+}
+[[noreturn]] void __throw_bad_array_new_length()
+{
+    abort();
+}
+[[noreturn]] void __throw_out_of_range_fmt(const char*, ...)
+{
+    abort();
+}
+[[noreturn]] void __throw_logic_error(const char*)
+{
+    abort();
+}
+} // namespace std
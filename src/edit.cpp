@@ -1,16 +1,22 @@
+#include <algorithm>
 #include <cerrno>
 #include <csignal>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <string>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
 #include <vector>
 
+#include "include/input.hpp"
+#include "include/utf8.hpp"
 #include "include/util.hpp"
 
 static std::string fileName{};
@@ -24,8 +30,13 @@ constexpr char ctrl_key(char c)
 }
 constexpr char CTRL_Q = ctrl_key('Q');
 constexpr char CTRL_S = ctrl_key('S');
+constexpr char CTRL_Y = ctrl_key('Y');
+constexpr char CTRL_Z = ctrl_key('Z');
 constexpr char BACKSPACE{0x7f};
 
+constexpr size_t UNDO_MEMORY_LIMIT = 8u << 20;
+constexpr size_t TAB_STOP = 8;
+
 static bool dirty{false};
 static bool running{true};
 static volatile sig_atomic_t gotSignal = 0;
@@ -33,6 +44,50 @@ static volatile sig_atomic_t gotSignal = 0;
 static std::vector<std::string> lines{""};
 static size_t cx{0};
 static size_t cy{0};
+static size_t rowOff{0};
+static size_t colOff{0};
+
+// Byte-to-column maps of the lines, built when a line is first needed and
+// patched by edits, so cursor columns are a lookup even on long lines.
+static std::vector<utf8::ColumnMap> colMaps(1);
+
+static InputReader input{};
+static std::string frame{};
+static bool pastedCR{false};
+
+// Undo history is an append-only log of primitive edits. Inserted and erased
+// text lives in one shared byte arena, so neither typing nor a large paste
+// ever snapshots the document. Ops sharing a group are undone as one step.
+enum class OpKind : uint8_t
+{
+    Insert, // text inserted into line y at x
+    Erase,  // text removed from line y at x
+    Split,  // line y broken in two at x
+    Join,   // line y + 1 appended to line y, which was x bytes long
+};
+
+struct EditOp
+{
+    uint32_t group;
+    OpKind kind;
+    uint32_t y;
+    uint32_t x;
+    uint32_t off;
+    uint32_t len;
+};
+
+struct UndoLog
+{
+    std::vector<EditOp> ops{};
+    std::string text{};
+    size_t applied{0}; // ops[applied..] are redo entries
+    size_t cleanMark{0};
+    uint32_t group{0};
+    bool coalesce{false};
+    bool held{false}; // keep appending to the current group (pastes)
+};
+
+static UndoLog undo{};
 
 static void disable_raw();
 
@@ -52,6 +107,7 @@ static void disable_raw()
     if (rawEnabled)
     {
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &origTermios);
+        print(BRACKETED_PASTE_OFF);
         rawEnabled = false;
     }
     if (altScreen)
@@ -76,6 +132,7 @@ static void enable_raw()
     raw.c_cc[VTIME] = 0;
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
         die("tcsetattr");
+    print(BRACKETED_PASTE_ON);
     rawEnabled = true;
     if (!altScreen)
     {
@@ -89,6 +146,20 @@ static void handle_signal(int32_t)
     gotSignal = 1;
 }
 
+static const utf8::ColumnMap& line_columns(size_t y)
+{
+    if (!colMaps[y].built)
+        colMaps[y].build(lines[y], 0, 0, TAB_STOP);
+    return colMaps[y];
+}
+
+// Line y changed from byte x on.
+static void line_changed(size_t y, size_t x)
+{
+    if (colMaps[y].built)
+        colMaps[y].build(lines[y], 0, x, TAB_STOP);
+}
+
 static void open_file()
 {
     if (fileName.empty())
@@ -97,6 +168,7 @@ static void open_file()
     if (fd == -1)
     {
         lines.assign(1, "");
+        colMaps.assign(1, utf8::ColumnMap{});
         cx = cy = 0;
         dirty = false;
         return;
@@ -124,6 +196,7 @@ static void open_file()
     close(fd);
     if (!cur.empty() || lines.empty())
         lines.push_back(cur);
+    colMaps.assign(lines.size(), utf8::ColumnMap{});
     cx = cy = 0;
     dirty = false;
 }
@@ -136,7 +209,10 @@ static bool save_file()
     if (!fd)
         return false;
     if (lines.back() != "")
+    {
         lines.push_back("");
+        colMaps.emplace_back();
+    }
     for (size_t i = 0; i < lines.size(); ++i)
     {
         const std::string& l = lines[i];
@@ -152,23 +228,189 @@ static bool save_file()
         }
     }
     dirty = false;
+    undo.cleanMark = undo.applied;
+    undo.coalesce = false;
     return true;
 }
 
-static void editor_insert_char(char c)
+static void apply_op(OpKind kind, size_t y, size_t x, const char* text, size_t len)
 {
-    if (c == '\n')
+    switch (kind)
     {
-        std::string rest = lines[cy].substr(cx);
-        lines[cy].erase(cx);
-        lines.insert(lines.begin() + cy + 1, rest);
-        cy++;
+    case OpKind::Insert:
+        lines[y].insert(x, text, len);
+        line_changed(y, x);
+        cy = y;
+        cx = x + len;
+        break;
+    case OpKind::Erase:
+        lines[y].erase(x, len);
+        line_changed(y, x);
+        cy = y;
+        cx = x;
+        break;
+    case OpKind::Split:
+        lines.insert(lines.begin() + static_cast<ptrdiff_t>(y) + 1, lines[y].substr(x));
+        lines[y].erase(x);
+        colMaps.insert(colMaps.begin() + static_cast<ptrdiff_t>(y) + 1, utf8::ColumnMap{});
+        line_changed(y, x);
+        cy = y + 1;
         cx = 0;
+        break;
+    case OpKind::Join:
+        lines[y] += lines[y + 1];
+        lines.erase(lines.begin() + static_cast<ptrdiff_t>(y) + 1);
+        colMaps.erase(colMaps.begin() + static_cast<ptrdiff_t>(y) + 1);
+        line_changed(y, x);
+        cy = y;
+        cx = x;
+        break;
+    }
+}
+
+static OpKind inverse(OpKind kind)
+{
+    switch (kind)
+    {
+    case OpKind::Insert:
+        return OpKind::Erase;
+    case OpKind::Erase:
+        return OpKind::Insert;
+    case OpKind::Split:
+        return OpKind::Join;
+    case OpKind::Join:
+        break;
+    }
+    return OpKind::Split;
+}
+
+static void undo_break()
+{
+    undo.coalesce = false;
+}
+
+static void undo_trim()
+{
+    if (undo.ops.size() * sizeof(EditOp) + undo.text.size() <= UNDO_MEMORY_LIMIT)
+        return;
+
+    // Drop roughly the older half at a group boundary so trimming stays
+    // amortised O(1) per op. If the newest group alone is over the limit,
+    // give up on history entirely rather than grow without bound.
+    size_t cut = undo.ops.size() / 2;
+    while (cut < undo.ops.size() && cut > 0 && undo.ops[cut].group == undo.ops[cut - 1].group)
+        cut++;
+    if (cut == undo.ops.size() || undo.ops[cut].group == undo.group)
+    {
+        undo.ops.clear();
+        undo.text.clear();
+        undo.applied = 0;
+        undo.cleanMark = dirty ? SIZE_MAX : 0;
+        undo_break();
+        return;
+    }
+
+    uint32_t base = undo.ops[cut].off;
+    undo.text.erase(0, base);
+    undo.ops.erase(undo.ops.begin(), undo.ops.begin() + static_cast<ptrdiff_t>(cut));
+    for (auto& op : undo.ops)
+        op.off -= base;
+    undo.applied -= cut;
+    undo.cleanMark = (undo.cleanMark >= cut && undo.cleanMark != SIZE_MAX) ? undo.cleanMark - cut : SIZE_MAX;
+}
+
+static void record(OpKind kind, size_t y, size_t x, const char* text, size_t len)
+{
+    if (undo.applied < undo.ops.size())
+    {
+        undo.ops.resize(undo.applied);
+        undo.text.resize(undo.ops.empty() ? 0 : undo.ops.back().off + undo.ops.back().len);
+        if (undo.cleanMark > undo.applied)
+            undo.cleanMark = SIZE_MAX;
+        undo.coalesce = false;
+    }
+
+    if (undo.coalesce && !undo.ops.empty())
+    {
+        EditOp& last = undo.ops.back();
+        if (kind == OpKind::Insert && last.kind == OpKind::Insert && last.y == y && last.x + last.len == x)
+        {
+            undo.text.append(text, len);
+            last.len += static_cast<uint32_t>(len);
+            undo_trim();
+            return;
+        }
+        // Consecutive backspaces stay separate records but undo together.
+        if (!undo.held && !(kind == OpKind::Erase && last.kind == OpKind::Erase && last.y == y && x + len == last.x))
+            undo.group++;
+    }
+    else if (!undo.held)
+    {
+        undo.group++;
+    }
+
+    undo.ops.push_back(EditOp{undo.group, kind, static_cast<uint32_t>(y), static_cast<uint32_t>(x),
+                              static_cast<uint32_t>(undo.text.size()), static_cast<uint32_t>(len)});
+    undo.text.append(text, len);
+    undo.applied = undo.ops.size();
+    undo.coalesce = (kind == OpKind::Insert || kind == OpKind::Erase);
+    undo_trim();
+}
+
+static void editor_undo()
+{
+    if (undo.applied == 0)
+        return;
+    uint32_t group = undo.ops[undo.applied - 1].group;
+    while (undo.applied > 0 && undo.ops[undo.applied - 1].group == group)
+    {
+        const EditOp& op = undo.ops[--undo.applied];
+        apply_op(inverse(op.kind), op.y, op.x, undo.text.data() + op.off, op.len);
+    }
+    if (undo.ops[undo.applied].kind == OpKind::Erase || undo.ops[undo.applied].kind == OpKind::Join)
+    {
+        // Put the cursor back where the user was before deleting.
+        const EditOp& op = undo.ops[undo.applied];
+        if (op.kind == OpKind::Erase)
+            cx = op.x + op.len;
+        else
+        {
+            cy = op.y + 1;
+            cx = 0;
+        }
+    }
+    dirty = undo.applied != undo.cleanMark;
+    undo_break();
+}
+
+static void editor_redo()
+{
+    if (undo.applied == undo.ops.size())
+        return;
+    uint32_t group = undo.ops[undo.applied].group;
+    while (undo.applied < undo.ops.size() && undo.ops[undo.applied].group == group)
+    {
+        const EditOp& op = undo.ops[undo.applied++];
+        apply_op(op.kind, op.y, op.x, undo.text.data() + op.off, op.len);
+    }
+    dirty = undo.applied != undo.cleanMark;
+    undo_break();
+}
+
+static void editor_insert_char(int32_t c)
+{
+    if (c == '\n')
+    {
+        record(OpKind::Split, cy, cx, nullptr, 0);
+        apply_op(OpKind::Split, cy, cx, nullptr, 0);
+        undo_break();
         dirty = true;
         return;
     }
-    lines[cy].insert(lines[cy].begin() + static_cast<int32_t>(cx), c);
-    cx++;
+    char buf[4];
+    size_t len = utf8::encode(static_cast<uint32_t>(c), buf);
+    record(OpKind::Insert, cy, cx, buf, len);
+    apply_op(OpKind::Insert, cy, cx, buf, len);
     dirty = true;
 }
 
@@ -179,41 +421,43 @@ static void editor_backspace()
         if (cy == 0)
             return;
         size_t prevLen = lines[cy - 1].size();
-        lines[cy - 1] += lines[cy];
-        lines.erase(lines.begin() + cy);
-        cy--;
-        cx = prevLen;
+        record(OpKind::Join, cy - 1, prevLen, nullptr, 0);
+        apply_op(OpKind::Join, cy - 1, prevLen, nullptr, 0);
+        undo_break();
         dirty = true;
         return;
     }
-    lines[cy].erase(lines[cy].begin() + static_cast<int32_t>(cx) - 1);
-    cx--;
+    // A character goes together with its combining marks.
+    size_t from = utf8::prev(lines[cy], cx);
+    record(OpKind::Erase, cy, from, &lines[cy][from], cx - from);
+    apply_op(OpKind::Erase, cy, from, nullptr, cx - from);
     dirty = true;
 }
 
 static void move_cursor(char dir)
 {
+    undo_break();
     switch (dir)
     {
     case 'A': // up
         if (cy > 0)
         {
+            size_t col = line_columns(cy).column(cx);
             cy--;
-            if (cx > lines[cy].size())
-                cx = lines[cy].size();
+            cx = line_columns(cy).byte_at(lines[cy], col);
         }
         break;
     case 'B': // down
         if (cy + 1 < lines.size())
         {
+            size_t col = line_columns(cy).column(cx);
             cy++;
-            if (cx > lines[cy].size())
-                cx = lines[cy].size();
+            cx = line_columns(cy).byte_at(lines[cy], col);
         }
         break;
     case 'C': // right
         if (cx < lines[cy].size())
-            cx++;
+            cx = utf8::next(lines[cy], cx);
         else if (cy + 1 < lines.size())
         {
             cy++;
@@ -222,7 +466,7 @@ static void move_cursor(char dir)
         break;
     case 'D': // left
         if (cx > 0)
-            cx--;
+            cx = utf8::prev(lines[cy], cx);
         else if (cy > 0)
         {
             cy--;
@@ -232,75 +476,190 @@ static void move_cursor(char dir)
     }
 }
 
+static void window_size(size_t& rows, size_t& cols)
+{
+    winsize ws{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0 || ws.ws_col == 0)
+    {
+        rows = 24;
+        cols = 80;
+        return;
+    }
+    rows = ws.ws_row;
+    cols = ws.ws_col;
+}
+
+static void scroll(size_t textRows, size_t cols)
+{
+    if (cy < rowOff)
+        rowOff = cy;
+    if (cy >= rowOff + textRows)
+        rowOff = cy - textRows + 1;
+    // Horizontal scrolling is in columns; a wide character under the
+    // cursor is brought fully into view.
+    size_t col = line_columns(cy).column(cx);
+    size_t width = cx < lines[cy].size() ? std::max(utf8::char_width(lines[cy], cx), 1u) : 1;
+    if (col < colOff)
+        colOff = col;
+    if (col + width > colOff + cols)
+        colOff = std::min(col, col + width - cols);
+}
+
+// The columns [colOff, colOff + cols) of line y. Tabs are drawn as spaces
+// up to the next stop; a wide character cut by either edge is left blank.
+static void draw_row(size_t y, size_t cols)
+{
+    const std::string& line = lines[y];
+    const utf8::ColumnMap& map = line_columns(y);
+    size_t from = colOff ? map.byte_at(line, colOff) : 0;
+    if (from < line.size() && line[from] != '\t' && map.column(from) < colOff)
+    {
+        frame += ' ';
+        from = utf8::next(line, from);
+    }
+    size_t to = map.byte_at(line, colOff + cols);
+    while (from < to)
+    {
+        size_t end = std::min(line.find('\t', from), to);
+        if (from < end)
+            utf8::append_display(frame, std::string_view(line).substr(from, end - from));
+        if (end == to)
+            break;
+        frame.append(map.column(end + 1) - std::max(map.column(end), colOff), ' ');
+        from = end + 1;
+    }
+}
+
 static void refresh_screen()
 {
-    // Hide cursor
-    print("\x1b[?25l");
-    print("\x1b[H");
+    size_t rows{}, cols{};
+    window_size(rows, cols);
+    size_t textRows = rows > 1 ? rows - 1 : 1;
+    scroll(textRows, cols);
 
-    for (const auto& l : lines)
+    // The whole frame is composed first and written once; only the visible
+    // window of the document is drawn.
+    frame.clear();
+    frame += "\x1b[?25l\x1b[H";
+
+    for (size_t r = 0; r < textRows; ++r)
     {
-        print(l);
-        print("\x1b[K\r\n");
+        size_t y = rowOff + r;
+        if (y < lines.size())
+            draw_row(y, cols);
+        frame += "\x1b[K\r\n";
     }
 
     // Status line (inverse video)
-    print("\x1b[7m ");
-    std::string status = "EDIT ";
-    status += fileName.empty() ? "[No Name]" : fileName;
+    frame += "\x1b[7m EDIT ";
+    frame += fileName.empty() ? "[No Name]" : fileName;
     if (dirty)
-        status += "*";
-    status += "  Ctrl-S=Save  Ctrl-Q=Quit";
-    print(status);
-    print("\x1b[m");
-    print("\x1b[K\r\n");
+        frame += "*";
+    frame += "  Ctrl-S=Save  Ctrl-Z=Undo  Ctrl-Y=Redo  Ctrl-Q=Quit";
+    frame += "\x1b[m\x1b[K";
 
     char buf[64];
-    std::snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", cy + 1, cx + 1);
-    print(buf);
+    std::snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", cy - rowOff + 1, line_columns(cy).column(cx) - colOff + 1);
+    frame += buf;
 
-    print("\x1b[?25h");
+    frame += "\x1b[?25h";
+    if (!write_all(STDOUT_FILENO, frame.data(), frame.size()))
+        die("write");
 }
 
-static void process_key()
+static void process_key(int32_t key)
 {
-    char c;
-    ssize_t n = read(STDIN_FILENO, &c, 1);
-    if (n <= 0)
-        return;
+    // Terminals send pasted line breaks as CR, CRLF or LF; fold them into
+    // one newline each.
+    bool afterCR = pastedCR;
+    pastedCR = false;
 
-    if (c == '\x1b')
+    switch (key)
     {
-        char seq[2];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1)
-            return;
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
-            return;
-        if (seq[0] == '[')
+    case KEY_NONE:
+        return;
+    case KEY_PASTE_START:
+        // A paste is a single undo step.
+        undo_break();
+        undo.group++;
+        undo.held = true;
+        return;
+    case KEY_PASTE_END:
+        undo.held = false;
+        undo_break();
+        return;
+    case KEY_UP:
+        move_cursor('A');
+        return;
+    case KEY_DOWN:
+        move_cursor('B');
+        return;
+    case KEY_RIGHT:
+        move_cursor('C');
+        return;
+    case KEY_LEFT:
+        move_cursor('D');
+        return;
+    case KEY_HOME:
+        undo_break();
+        cx = 0;
+        return;
+    case KEY_END:
+        undo_break();
+        cx = lines[cy].size();
+        return;
+    case KEY_PAGE_UP:
+    case KEY_PAGE_DOWN: {
+        size_t rows{}, cols{};
+        window_size(rows, cols);
+        for (size_t i = 1; i < rows; ++i)
+            move_cursor(key == KEY_PAGE_UP ? 'A' : 'B');
+        return;
+    }
+    case KEY_DELETE:
+        if (cx < lines[cy].size() || cy + 1 < lines.size())
         {
-            move_cursor(seq[1]);
+            move_cursor('C');
+            editor_backspace();
         }
         return;
-    }
-
-    switch (c)
-    {
     case CTRL_Q:
+        if (input.pasting)
+            break;
         running = false;
         return;
     case CTRL_S:
+        if (input.pasting)
+            break;
         save_file();
         return;
+    case CTRL_Z:
+        if (input.pasting)
+            break;
+        editor_undo();
+        return;
+    case CTRL_Y:
+        if (input.pasting)
+            break;
+        editor_redo();
+        return;
     case BACKSPACE:
+        if (input.pasting)
+            break;
         editor_backspace();
         return;
     case '\r':
+        pastedCR = input.pasting;
         editor_insert_char('\n');
         return;
+    case '\n':
+        if (input.pasting && !afterCR)
+            editor_insert_char('\n');
+        return;
     default:
-        if (c >= 32 && c <= 126)
+        if (utf8::printable(key) || key == '\t')
         {
-            editor_insert_char(c);
+            editor_insert_char(key);
         }
         break;
     }
@@ -331,7 +690,16 @@ int32_t main(int32_t argc, char* argv[])
         if (gotSignal)
             running = false;
         refresh_screen();
-        process_key();
+
+        // Apply everything that is already queued before drawing again, so
+        // a paste costs a few reads and one redraw instead of one per byte.
+        ssize_t n = input.fill();
+        if (n == 0)
+            break;
+        if (n < 0 && errno != EINTR)
+            die("read");
+        while (running && input.pending())
+            process_key(input.next_key());
     }
 
     disable_raw();
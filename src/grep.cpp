@@ -0,0 +1,464 @@
+#include <bitset>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#include "include/scan.hpp"
+#include "include/util.hpp"
+
+// grep [-F] [-i] [-v] [-c] [-n] [-q] pattern [file...]
+//
+// Patterns are basic regular expressions limited to ^ $ . * [...] and
+// backslash escapes; -F takes the pattern literally. The pattern's longest
+// literal run is located with the SIMD substring search over whole chunks,
+// so only lines containing it are looked at; a plain string needs no
+// matcher at all.
+
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+struct Atom
+{
+    enum class Kind
+    {
+        Char,
+        Any,
+        Class,
+    } kind{Kind::Char};
+    bool star{false};
+    char c{0};
+    std::bitset<256> set{};
+};
+
+class Pattern
+{
+  public:
+    // Returns an error message, or nullptr.
+    const char* compile(std::string_view re, bool fixed, bool fold_case)
+    {
+        icase = fold_case;
+        size_t i = 0;
+        if (fixed)
+        {
+            for (char c : re)
+                atoms.push_back(char_atom(c));
+            i = re.size();
+        }
+        else if (!re.empty() && re[0] == '^')
+        {
+            anchored_start = true;
+            i = 1;
+        }
+        while (i < re.size())
+        {
+            char c = re[i];
+            if (c == '$' && i + 1 == re.size())
+            {
+                anchored_end = true;
+                break;
+            }
+            Atom a;
+            if (c == '.')
+            {
+                a.kind = Atom::Kind::Any;
+                i++;
+            }
+            else if (c == '[')
+            {
+                const char* err = parse_class(re, i, a);
+                if (err)
+                    return err;
+            }
+            else if (c == '\\')
+            {
+                if (i + 1 == re.size())
+                    return "trailing backslash";
+                a = char_atom(re[i + 1]);
+                i += 2;
+            }
+            else
+            {
+                a = char_atom(c);
+                i++;
+            }
+            if (i < re.size() && re[i] == '*')
+            {
+                a.star = true;
+                i++;
+            }
+            atoms.push_back(a);
+        }
+        pick_literal();
+        return nullptr;
+    }
+
+    // Finds the first matching line in [p, end), which holds whole lines.
+    // The line is [line, line_end) without its newline.
+    bool next_match(const char* p, const char* end, const char*& line, const char*& line_end) const
+    {
+        while (p < end)
+        {
+            if (!literal.empty())
+            {
+                const char* hit = scan::find_substr(p, end, literal, icase);
+                if (hit == end)
+                    return false;
+                line = scan::line_start(p, hit);
+                line_end = scan::find_byte(hit, end, '\n');
+            }
+            else
+            {
+                line = p;
+                line_end = scan::find_byte(p, end, '\n');
+            }
+            if (plain || match_line(line, line_end))
+                return true;
+            p = line_end < end ? line_end + 1 : end;
+        }
+        return false;
+    }
+
+  private:
+    std::vector<Atom> atoms{};
+    std::string literal{};
+    bool plain{false}; // the literal is the whole pattern
+    bool anchored_start{false};
+    bool anchored_end{false};
+    bool icase{false};
+
+    Atom char_atom(char c) const
+    {
+        Atom a;
+        a.c = icase ? scan::fold(c) : c;
+        return a;
+    }
+
+    // [abc], [a-z], [^...]; a leading ']' is literal.
+    const char* parse_class(std::string_view re, size_t& i, Atom& a) const
+    {
+        a.kind = Atom::Kind::Class;
+        size_t j = i + 1;
+        bool negate = j < re.size() && re[j] == '^';
+        if (negate)
+            j++;
+        size_t first = j;
+        while (j < re.size() && (re[j] != ']' || j == first))
+        {
+            auto lo = static_cast<unsigned char>(re[j]), hi = lo;
+            if (j + 2 < re.size() && re[j + 1] == '-' && re[j + 2] != ']')
+            {
+                hi = static_cast<unsigned char>(re[j + 2]);
+                j += 2;
+            }
+            for (unsigned c = lo; c <= hi; ++c)
+            {
+                a.set.set(c);
+                if (icase)
+                {
+                    a.set.set(static_cast<unsigned char>(scan::fold(static_cast<char>(c))));
+                    a.set.set(static_cast<unsigned char>(scan::unfold(static_cast<char>(c))));
+                }
+            }
+            j++;
+        }
+        if (j >= re.size())
+            return "unterminated [";
+        if (negate)
+            a.set.flip();
+        i = j + 1;
+        return nullptr;
+    }
+
+    // The longest run of plain characters; every match contains it.
+    void pick_literal()
+    {
+        std::string run;
+        for (size_t i = 0; i <= atoms.size(); ++i)
+        {
+            if (i < atoms.size() && atoms[i].kind == Atom::Kind::Char && !atoms[i].star)
+            {
+                run += atoms[i].c;
+                continue;
+            }
+            if (run.size() > literal.size())
+                literal = run;
+            run.clear();
+        }
+        plain = !anchored_start && !anchored_end && literal.size() == atoms.size();
+    }
+
+    bool matches(const Atom& a, char c) const
+    {
+        switch (a.kind)
+        {
+        case Atom::Kind::Any:
+            return true;
+        case Atom::Kind::Class:
+            return a.set.test(static_cast<unsigned char>(c));
+        default:
+            return (icase ? scan::fold(c) : c) == a.c;
+        }
+    }
+
+    bool match_here(size_t i, const char* p, const char* end) const
+    {
+        for (; i < atoms.size(); ++i)
+        {
+            const Atom& a = atoms[i];
+            if (a.star)
+            {
+                // Greedy, then give characters back.
+                const char* q = p;
+                while (q < end && matches(a, *q))
+                    q++;
+                for (;; --q)
+                {
+                    if (match_here(i + 1, q, end))
+                        return true;
+                    if (q == p)
+                        return false;
+                }
+            }
+            if (p == end || !matches(a, *p))
+                return false;
+            p++;
+        }
+        return !anchored_end || p == end;
+    }
+
+    bool match_line(const char* begin, const char* end) const
+    {
+        if (anchored_start)
+            return match_here(0, begin, end);
+        for (const char* p = begin;; ++p)
+        {
+            if (match_here(0, p, end))
+                return true;
+            if (p == end)
+                return false;
+        }
+    }
+};
+
+struct Options
+{
+    bool fixed{false};
+    bool icase{false};
+    bool invert{false};
+    bool count{false};
+    bool number{false};
+    bool quiet{false};
+};
+
+class Output
+{
+  public:
+    Output()
+    {
+        buf.reserve(OUTPUT_BUFFER_SIZE);
+    }
+
+    ~Output()
+    {
+        flush();
+    }
+
+    void append(const char* p, size_t n)
+    {
+        if (buf.size() + n > OUTPUT_BUFFER_SIZE)
+            flush();
+        if (n >= OUTPUT_BUFFER_SIZE)
+        {
+            write_all(STDOUT_FILENO, p, n);
+            return;
+        }
+        buf.insert(buf.end(), p, p + n);
+    }
+
+    void append(std::string_view s)
+    {
+        append(s.data(), s.size());
+    }
+
+    void flush()
+    {
+        write_all(STDOUT_FILENO, buf.data(), buf.size());
+        buf.clear();
+    }
+
+  private:
+    std::vector<char> buf{};
+};
+
+// State for one input.
+struct Search
+{
+    const Pattern& pattern;
+    const Options& opt;
+    Output& out;
+    std::string_view prefix; // "name:" with several files
+    size_t line_no{0};       // lines before the current position
+    size_t selected{0};
+
+    // One selected line, [line, line_end) without its newline.
+    void emit(const char* line, const char* line_end)
+    {
+        selected++;
+        if (opt.count || opt.quiet)
+            return;
+        out.append(prefix);
+        if (opt.number)
+        {
+            char num[24];
+            int n = std::snprintf(num, sizeof num, "%zu:", line_no);
+            out.append(num, static_cast<size_t>(n));
+        }
+        out.append(line, static_cast<size_t>(line_end - line));
+        out.append("\n", 1);
+    }
+
+    // Lines in [p, end) that contain no match: selected only with -v.
+    void skip(const char* p, const char* end)
+    {
+        if (!opt.invert)
+        {
+            if (opt.number)
+                line_no += scan::count_byte(p, static_cast<size_t>(end - p), '\n');
+            return;
+        }
+        while (p < end)
+        {
+            const char* nl = scan::find_byte(p, end, '\n');
+            line_no++;
+            emit(p, nl);
+            p = nl < end ? nl + 1 : end;
+        }
+    }
+
+    // [begin, end) holds whole lines.
+    void chunk(const char* begin, const char* end)
+    {
+        const char* p = begin;
+        const char *line, *line_end;
+        while (p < end && pattern.next_match(p, end, line, line_end))
+        {
+            skip(p, line);
+            line_no++;
+            if (!opt.invert)
+                emit(line, line_end);
+            p = line_end < end ? line_end + 1 : end;
+            if (opt.quiet && selected > 0)
+                return;
+        }
+        skip(p, end);
+    }
+};
+
+static bool parse_options(std::string_view prog, const std::vector<std::string_view>& args, Options& opt,
+                          std::vector<std::string_view>& operands)
+{
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        std::string_view a = args[i];
+        if (a.size() < 2 || a[0] != '-' || !operands.empty())
+        {
+            operands.push_back(a);
+            continue;
+        }
+        for (char f : a.substr(1))
+        {
+            switch (f)
+            {
+            case 'F':
+                opt.fixed = true;
+                break;
+            case 'i':
+                opt.icase = true;
+                break;
+            case 'v':
+                opt.invert = true;
+                break;
+            case 'c':
+                opt.count = true;
+                break;
+            case 'n':
+                opt.number = true;
+                break;
+            case 'q':
+                opt.quiet = true;
+                break;
+            default:
+                print_error("ERROR: ");
+                print_error(prog);
+                print_error(": unknown option '");
+                print_error(a);
+                print_error("'\r\n");
+                return false;
+            }
+        }
+    }
+    return require_args(prog, operands.size(), 1, "usage: grep [-F] [-i] [-v] [-c] [-n] [-q] pattern [file...]");
+}
+
+int32_t main(int32_t argc, char* argv[])
+{
+    auto args = make_args(argc, argv);
+    auto prog = prog_name(args[0]);
+
+    Options opt;
+    std::vector<std::string_view> operands;
+    if (!parse_options(prog, args, opt, operands))
+        return 2;
+
+    Pattern pattern;
+    if (const char* err = pattern.compile(operands[0], opt.fixed, opt.icase))
+    {
+        print_error("ERROR: ");
+        print_error(prog);
+        print_error(": ");
+        print_error(err);
+        print_error("\r\n");
+        return 2;
+    }
+
+    std::vector<std::string_view> files(operands.begin() + 1, operands.end());
+    if (files.empty())
+        files.push_back("-");
+
+    Output out;
+    bool any = false, failed = false;
+    for (std::string_view name : files)
+    {
+        FD file(name == "-" ? dup(STDIN_FILENO) : open(name.data(), O_RDONLY | O_CLOEXEC));
+        if (!file)
+        {
+            print_errno(prog, "open", name);
+            failed = true;
+            continue;
+        }
+        std::string prefix = files.size() > 1 ? std::string(name) + ":" : std::string();
+        Search search{pattern, opt, out, prefix};
+        scan::LineChunks chunks;
+        const char *begin, *end;
+        while (!(opt.quiet && search.selected) && chunks.next(file.get(), begin, end))
+            search.chunk(begin, end);
+        if (chunks.failed)
+        {
+            print_errno(prog, "read", name);
+            failed = true;
+        }
+        if (opt.count)
+        {
+            out.append(prefix);
+            out.append(std::to_string(search.selected));
+            out.append("\n", 1);
+        }
+        any = any || search.selected > 0;
+        if (opt.quiet && any)
+            return 0;
+    }
+    return failed ? 2 : any ? 0 : 1;
+}
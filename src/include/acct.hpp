@@ -0,0 +1,155 @@
+#ifndef ACCT_HPP
+#define ACCT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+
+#include "util.hpp"
+
+constexpr const char* ACCT_ENV = "SHELL_ACCT_FILE";
+
+inline int64_t monotonic_ns()
+{
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+inline int64_t timeval_us(const struct timeval& tv)
+{
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// What one command cost. Wall time is CLOCK_MONOTONIC; the rest is the
+// child's rusage as returned by waitid, or the shell's own RUSAGE_SELF
+// delta for builtins (max RSS is then the shell's).
+struct Usage
+{
+    int64_t start_ns{0};
+    int64_t wall_ns{0};
+    struct rusage ru{};
+
+    void begin()
+    {
+        start_ns = monotonic_ns();
+        ru = {};
+    }
+
+    void end()
+    {
+        wall_ns = monotonic_ns() - start_ns;
+    }
+
+    // ru = after - before, for builtins.
+    void self_delta(const struct rusage& before, const struct rusage& after)
+    {
+        auto sub = [](const struct timeval& a, const struct timeval& b) {
+            int64_t us = timeval_us(a) - timeval_us(b);
+            return timeval{static_cast<time_t>(us / 1000000), static_cast<suseconds_t>(us % 1000000)};
+        };
+        ru.ru_utime = sub(after.ru_utime, before.ru_utime);
+        ru.ru_stime = sub(after.ru_stime, before.ru_stime);
+        ru.ru_maxrss = after.ru_maxrss;
+        ru.ru_minflt = after.ru_minflt - before.ru_minflt;
+        ru.ru_majflt = after.ru_majflt - before.ru_majflt;
+        ru.ru_nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+        ru.ru_nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+    }
+};
+
+// Report for the `time` builtin, on stderr.
+inline void print_usage(const Usage& u)
+{
+    char buf[320];
+    int n = std::snprintf(buf, sizeof buf,
+                          "real    %.3fs\r\n"
+                          "user    %.3fs\r\n"
+                          "sys     %.3fs\r\n"
+                          "maxrss  %ld KiB\r\n"
+                          "faults  %ld minor, %ld major\r\n"
+                          "ctxsw   %ld voluntary, %ld involuntary\r\n",
+                          static_cast<double>(u.wall_ns) / 1e9, static_cast<double>(timeval_us(u.ru.ru_utime)) / 1e6,
+                          static_cast<double>(timeval_us(u.ru.ru_stime)) / 1e6, u.ru.ru_maxrss, u.ru.ru_minflt,
+                          u.ru.ru_majflt, u.ru.ru_nvcsw, u.ru.ru_nivcsw);
+    print_error(std::string_view(buf, static_cast<size_t>(n)));
+}
+
+// Always-on accounting: one JSON object per executed command appended to a
+// file. Each record is a single write, so several shells can share a file.
+struct Accounting
+{
+    FD file{};
+    std::string line{};
+
+    bool enabled() const
+    {
+        return static_cast<bool>(file);
+    }
+
+    bool open(const char* path)
+    {
+        FD f(::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
+        if (!f)
+            return false;
+        file = std::move(f);
+        return true;
+    }
+
+    void close()
+    {
+        file = FD();
+    }
+
+    void record(int32_t argc, char** argv, int32_t status, const Usage& u)
+    {
+        line.assign("{\"cmd\":\"");
+        for (int32_t i = 0; i < argc; ++i)
+        {
+            if (i > 0)
+                line += ' ';
+            append_escaped(argv[i]);
+        }
+        char buf[320];
+        int n = std::snprintf(buf, sizeof buf,
+                              "\",\"status\":%d,\"start_us\":%lld,\"wall_us\":%lld,\"user_us\":%lld,"
+                              "\"sys_us\":%lld,\"maxrss_kb\":%ld,\"minflt\":%ld,\"majflt\":%ld,"
+                              "\"nvcsw\":%ld,\"nivcsw\":%ld}\n",
+                              status, static_cast<long long>(u.start_ns / 1000),
+                              static_cast<long long>(u.wall_ns / 1000),
+                              static_cast<long long>(timeval_us(u.ru.ru_utime)),
+                              static_cast<long long>(timeval_us(u.ru.ru_stime)), u.ru.ru_maxrss, u.ru.ru_minflt,
+                              u.ru.ru_majflt, u.ru.ru_nvcsw, u.ru.ru_nivcsw);
+        line.append(buf, static_cast<size_t>(n));
+        write_all(file.get(), line.data(), line.size());
+    }
+
+  private:
+    void append_escaped(std::string_view s)
+    {
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                line += '\\';
+                line += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char esc[8];
+                std::snprintf(esc, sizeof esc, "\\u%04x", c);
+                line += esc;
+            }
+            else
+            {
+                line += c;
+            }
+        }
+    }
+};
+
+#endif // ACCT_HPP
@@ -0,0 +1,86 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+constexpr size_t ARENA_BLOCK_SIZE = 4096;
+
+// Bump allocator. reset() rewinds to the first block but keeps every block,
+// so once an arena has grown to a workload's high-water mark it stops
+// calling malloc altogether.
+struct Arena
+{
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks{};
+    size_t block_size{ARENA_BLOCK_SIZE};
+    size_t cur{0};
+    size_t used{0};
+
+    Arena() = default;
+    explicit Arena(size_t first_block) : block_size(first_block)
+    {
+    }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t n, size_t align = alignof(std::max_align_t))
+    {
+        while (cur < blocks.size())
+        {
+            size_t at = (used + align - 1) & ~(align - 1);
+            if (at + n <= blocks[cur].size)
+            {
+                used = at + n;
+                return blocks[cur].data.get() + at;
+            }
+            cur++;
+            used = 0;
+        }
+        size_t size = block_size << (blocks.size() < 8 ? blocks.size() : 8);
+        if (size < n + align)
+            size = n + align;
+        blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        cur = blocks.size() - 1;
+        used = 0;
+        return alloc(n, align);
+    }
+
+    template <typename T> T* array(size_t n)
+    {
+        return static_cast<T*>(alloc(sizeof(T) * (n ? n : 1), alignof(T)));
+    }
+
+    template <typename T> T* copy(const T* src, size_t n)
+    {
+        T* dst = array<T>(n);
+        if (n)
+            memcpy(dst, src, sizeof(T) * n);
+        return dst;
+    }
+
+    // NUL-terminated copy.
+    char* str(std::string_view s)
+    {
+        char* p = static_cast<char*>(alloc(s.size() + 1, 1));
+        memcpy(p, s.data(), s.size());
+        p[s.size()] = '\0';
+        return p;
+    }
+
+    void reset()
+    {
+        cur = 0;
+        used = 0;
+    }
+};
+
+#endif // ARENA_HPP
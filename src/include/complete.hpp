@@ -0,0 +1,282 @@
+#ifndef COMPLETE_HPP
+#define COMPLETE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "util.hpp"
+
+// Same fallback execvp uses when PATH is unset.
+constexpr const char* DEFAULT_PATH = "/bin:/usr/bin";
+
+// Sorted, de-duplicated index of every executable reachable through PATH
+// plus the shell builtins. Names are packed into one buffer; lookups are a
+// binary search for the prefix. The index is rebuilt only when PATH changes
+// or one of its directories is modified.
+struct CommandIndex
+{
+    struct Entry
+    {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    std::string path{};
+    std::vector<timespec> mtimes{};
+    std::string names{};
+    std::vector<Entry> entries{};
+    bool built{false};
+
+    std::string_view name(const Entry& e) const
+    {
+        return {names.data() + e.off, e.len};
+    }
+
+    template <size_t N> void refresh(const std::string_view (&builtins)[N])
+    {
+        const char* env = getenv("PATH");
+        std::string_view current = env ? env : DEFAULT_PATH;
+        if (built && current == path && !dirs_changed())
+            return;
+        rebuild(current, builtins, N);
+    }
+
+    // Appends every indexed name starting with prefix to out.
+    void lookup(std::string_view prefix, std::vector<std::string>& out) const
+    {
+        auto it = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                   [&](const Entry& e, std::string_view p) { return name(e) < p; });
+        for (; it != entries.end(); ++it)
+        {
+            std::string_view n = name(*it);
+            if (n.substr(0, prefix.size()) != prefix)
+                break;
+            out.emplace_back(n);
+        }
+    }
+
+  private:
+    template <typename F> void for_each_dir(F&& fn) const
+    {
+        std::string_view rest = path;
+        while (true)
+        {
+            size_t colon = rest.find(':');
+            std::string_view dir = rest.substr(0, colon);
+            fn(dir.empty() ? std::string(".") : std::string(dir));
+            if (colon == std::string_view::npos)
+                break;
+            rest.remove_prefix(colon + 1);
+        }
+    }
+
+    bool dirs_changed() const
+    {
+        size_t i = 0;
+        bool changed = false;
+        for_each_dir([&](const std::string& dir) {
+            struct stat st{};
+            timespec m{};
+            if (stat(dir.c_str(), &st) == 0)
+                m = st.st_mtim;
+            if (i >= mtimes.size() || m.tv_sec != mtimes[i].tv_sec || m.tv_nsec != mtimes[i].tv_nsec)
+                changed = true;
+            i++;
+        });
+        return changed;
+    }
+
+    void add(std::string_view n)
+    {
+        entries.push_back({static_cast<uint32_t>(names.size()), static_cast<uint32_t>(n.size())});
+        names.append(n);
+    }
+
+    void rebuild(std::string_view current, const std::string_view* builtins, size_t count)
+    {
+        path.assign(current);
+        mtimes.clear();
+        names.clear();
+        entries.clear();
+
+        for (size_t i = 0; i < count; ++i)
+            add(builtins[i]);
+
+        for_each_dir([&](const std::string& dir) {
+            timespec m{};
+            FD fd(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            struct stat st{};
+            if (fd && fstat(fd.get(), &st) == 0)
+                m = st.st_mtim;
+            mtimes.push_back(m);
+            if (!fd)
+                return;
+            for_each_dirent(fd.get(), [&](std::string_view n, unsigned char type) {
+                if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+                    return;
+                std::string file(n);
+                struct stat st{};
+                if (type != DT_REG && (fstatat(fd.get(), file.c_str(), &st, 0) != 0 || !S_ISREG(st.st_mode)))
+                    return;
+                if (faccessat(fd.get(), file.c_str(), X_OK, 0) == 0)
+                    add(n);
+            });
+        });
+
+        std::sort(entries.begin(), entries.end(),
+                  [&](const Entry& a, const Entry& b) { return name(a) < name(b); });
+        entries.erase(std::unique(entries.begin(), entries.end(),
+                                  [&](const Entry& a, const Entry& b) { return name(a) == name(b); }),
+                      entries.end());
+        built = true;
+    }
+};
+
+// Appends to out every path that completes word: the entries of word's
+// directory part (relative to the cwd) starting with its last component.
+// Directories get a trailing '/'. Returns the length of the directory part.
+inline size_t complete_path(std::string_view word, std::vector<std::string>& out)
+{
+    size_t slash = word.rfind('/');
+    size_t dir_len = (slash == std::string_view::npos) ? 0 : slash + 1;
+    std::string dir(word.substr(0, dir_len));
+    std::string_view base = word.substr(dir_len);
+
+    FD fd(openat(AT_FDCWD, dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!fd)
+        return dir_len;
+
+    for_each_dirent(fd.get(), [&](std::string_view n, unsigned char type) {
+        if (n.substr(0, base.size()) != base)
+            return;
+        if (n[0] == '.' && (base.empty() || base[0] != '.'))
+            return;
+        bool is_dir = type == DT_DIR;
+        if (type == DT_LNK || type == DT_UNKNOWN)
+        {
+            struct stat st{};
+            std::string name(n);
+            is_dir = fstatat(fd.get(), name.c_str(), &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        std::string& s = out.emplace_back(dir);
+        s.append(n);
+        if (is_dir)
+            s += '/';
+    });
+    std::sort(out.begin(), out.end());
+    return dir_len;
+}
+
+// The word being completed: where it starts in the line, its text with
+// quotes and escapes removed, and whether it is in command position (first
+// in the line or after ';', '&', '&&' or '||').
+struct CompletionWord
+{
+    size_t start{0};
+    std::string text{};
+    bool command{true};
+};
+
+// Scans line up to pos with the parser's quoting rules. An unterminated
+// quote belongs to the word, so completing it replaces the quote too.
+inline CompletionWord word_before(std::string_view line, size_t pos)
+{
+    CompletionWord w{};
+    bool in_word = false;
+    char quote = 0;
+    auto begin = [&](size_t i) {
+        if (in_word)
+            return;
+        in_word = true;
+        w.start = i;
+        w.text.clear();
+    };
+    for (size_t i = 0; i < pos; ++i)
+    {
+        char c = line[i];
+        if (quote != 0)
+        {
+            bool escape = quote == '"' && c == '\\' && i + 1 < pos &&
+                          std::string_view("$\"\\`").find(line[i + 1]) != std::string_view::npos;
+            if (c == quote)
+                quote = 0;
+            else
+                w.text += escape ? line[++i] : c;
+            continue;
+        }
+        switch (c)
+        {
+        case ' ':
+        case '\t':
+        case '\n':
+            if (in_word)
+                w.command = false;
+            in_word = false;
+            break;
+        case ';':
+        case '&':
+        case '|':
+            in_word = false;
+            w.command = true;
+            break;
+        case '\'':
+        case '"':
+            begin(i);
+            quote = c;
+            break;
+        case '\\':
+            begin(i);
+            if (i + 1 < pos)
+                w.text += line[++i];
+            break;
+        default:
+            begin(i);
+            w.text += c;
+            break;
+        }
+    }
+    if (!in_word)
+    {
+        w.start = pos;
+        w.text.clear();
+    }
+    return w;
+}
+
+// Appends s backslash-escaped wherever the parser would otherwise split,
+// quote, expand or glob it, so the inserted word reads back as s.
+inline void append_escaped_word(std::string& out, std::string_view s)
+{
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        char c = s[i];
+        bool special = std::string_view(" \t\n;&|'\"\\$*?[").find(c) != std::string_view::npos;
+        if (special || (i == 0 && (c == '#' || c == '~')))
+            out += '\\';
+        out += c;
+    }
+}
+
+inline size_t common_prefix(const std::vector<std::string>& items)
+{
+    if (items.empty())
+        return 0;
+    size_t n = items[0].size();
+    for (const auto& s : items)
+    {
+        size_t i = 0;
+        while (i < n && i < s.size() && s[i] == items[0][i])
+            i++;
+        n = i;
+    }
+    return n;
+}
+
+#endif // COMPLETE_HPP
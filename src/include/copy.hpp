@@ -0,0 +1,432 @@
+#ifndef COPY_HPP
+#define COPY_HPP
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "util.hpp"
+
+constexpr size_t COPY_BUFFER_SIZE = 1 << 20;
+constexpr size_t COPY_RANGE_CHUNK = 1 << 30;
+constexpr unsigned MAX_COPY_THREADS = 8;
+
+// Ways to move a file's bytes, in the order they are tried.
+enum class Method
+{
+    Clone,  // FICLONE: the copy shares the source's extents (btrfs, xfs)
+    Range,  // copy_file_range: no user-space copy, may be offloaded
+    Buffer, // pread/pwrite through a large buffer
+};
+
+inline const char* method_name(Method m)
+{
+    switch (m)
+    {
+    case Method::Clone:
+        return "clone";
+    case Method::Range:
+        return "copy_file_range";
+    default:
+        return "buffer";
+    }
+}
+
+inline bool pwrite_all(int fd, const char* p, size_t len, off_t off)
+{
+    while (len > 0)
+    {
+        ssize_t w = pwrite(fd, p, len, off);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        off += w;
+        len -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+// Copies [off, end) at the same offsets. A copy_file_range the filesystem
+// pair does not support switches method to Buffer for the rest of the file.
+inline bool copy_extent(int in, int out, off_t off, off_t end, Method& method, std::vector<char>& buf)
+{
+    while (off < end)
+    {
+        size_t want = static_cast<size_t>(end - off);
+        if (method == Method::Range)
+        {
+            loff_t in_off = off, out_off = off;
+            ssize_t n = copy_file_range(in, &in_off, out, &out_off, std::min(want, COPY_RANGE_CHUNK), 0);
+            if (n > 0)
+            {
+                off += n;
+                continue;
+            }
+            if (n == 0)
+                return true; // source shrank
+            if (errno == EINTR)
+                continue;
+            if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+                return false;
+            method = Method::Buffer;
+        }
+        if (buf.empty())
+            buf.resize(COPY_BUFFER_SIZE);
+        ssize_t n = pread(in, buf.data(), std::min(want, buf.size()), off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n == 0;
+        if (!pwrite_all(out, buf.data(), static_cast<size_t>(n), off))
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+// Writes size bytes of in to out in order, for destinations that cannot be
+// seeked, cloned into or truncated (devices, FIFOs, terminals).
+inline bool stream_data(int in, int out, off_t size, std::vector<char>& buf)
+{
+    buf.resize(COPY_BUFFER_SIZE);
+    off_t off = 0;
+    while (off < size)
+    {
+        ssize_t n = pread(in, buf.data(), std::min(static_cast<size_t>(size - off), buf.size()), off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n == 0;
+        if (!write_all(out, buf.data(), static_cast<size_t>(n)))
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+// Copies size bytes of in to the empty file out, starting with method and
+// falling back down the list; on return method is the last one used. When
+// out is a regular file only the data extents reported by SEEK_DATA/SEEK_HOLE
+// are copied and the final ftruncate recreates the trailing hole, so sparse
+// files stay sparse; anything else gets the bytes streamed densely.
+// Returns false with errno set.
+inline bool copy_data(int in, int out, off_t size, Method& method)
+{
+    std::vector<char> buf;
+    struct stat ost;
+    if (fstat(out, &ost) != 0)
+        return false;
+    if (!S_ISREG(ost.st_mode))
+    {
+        method = Method::Buffer;
+        return stream_data(in, out, size, buf);
+    }
+    if (method == Method::Clone)
+    {
+        if (size > 0 && ioctl(out, FICLONE, in) == 0)
+            return true;
+        method = Method::Range;
+    }
+    off_t off = 0;
+    while (off < size)
+    {
+        off_t data = lseek(in, off, SEEK_DATA);
+        if (data < 0)
+        {
+            if (errno == ENXIO)
+                break; // the rest is a hole
+            data = off; // no SEEK_DATA support: treat the file as dense
+        }
+        if (data >= size)
+            break;
+        off_t hole = lseek(in, data, SEEK_HOLE);
+        if (hole < 0 || hole > size)
+            hole = size;
+        if (!copy_extent(in, out, data, hole, method, buf))
+            return false;
+        off = hole;
+    }
+    return ftruncate(out, size) == 0;
+}
+
+// Ownership (where permitted), mode and timestamps of st onto an open file.
+inline void copy_attributes(int fd, const struct stat& st)
+{
+    static_cast<void>(fchown(fd, st.st_uid, st.st_gid));
+    fchmod(fd, st.st_mode & 07777);
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    futimens(fd, times);
+}
+
+// Copies the regular file src (described by st) to dst, replacing dst's
+// contents. Returns false with errno set.
+inline bool copy_file(const char* src, const char* dst, const struct stat& st, bool preserve, Method& method)
+{
+    FD in(open(src, O_RDONLY | O_CLOEXEC));
+    if (!in)
+        return false;
+    FD out(open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777));
+    if (!out)
+        return false;
+    if (!copy_data(in.get(), out.get(), st.st_size, method))
+        return false;
+    if (preserve)
+        copy_attributes(out.get(), st);
+    return true;
+}
+
+inline std::string join_path(std::string_view dir, std::string_view name)
+{
+    std::string p(dir);
+    if (!p.empty() && p.back() != '/')
+        p += '/';
+    p += name;
+    return p;
+}
+
+// Last component of path, ignoring trailing slashes.
+inline std::string_view base_name(std::string_view path)
+{
+    while (path.size() > 1 && path.back() == '/')
+        path.remove_suffix(1);
+    return prog_name(path);
+}
+
+// Entries of a directory, read in one go so recursion holds no descriptor.
+inline bool list_dir(const char* path, std::vector<std::string>& names)
+{
+    FD dir(open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!dir)
+        return false;
+    return for_each_dirent(dir.get(), [&](std::string_view name, unsigned char) { names.emplace_back(name); });
+}
+
+// Copies regular files on worker threads while the caller walks the tree
+// and creates directories, links and special files itself. Directory modes
+// and times are applied in finish(), after the workers are done writing
+// into them. Errors are printed as they happen.
+class CopyPool
+{
+  public:
+    CopyPool(std::string_view prog, unsigned threads, bool preserve) : prog(prog), preserve(preserve)
+    {
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back([this] { work(); });
+    }
+
+    CopyPool(const CopyPool&) = delete;
+    CopyPool& operator=(const CopyPool&) = delete;
+
+    ~CopyPool()
+    {
+        finish();
+    }
+
+    static unsigned default_threads()
+    {
+        return std::clamp(std::thread::hardware_concurrency(), 1u, MAX_COPY_THREADS);
+    }
+
+    // Copies src (any file type, directories recursively) to dst. Returns
+    // false if something already failed; queued files may still fail later.
+    bool copy(const std::string& src, const std::string& dst, const struct stat& st)
+    {
+        if (S_ISREG(st.st_mode))
+        {
+            submit({src, dst, st});
+            return true;
+        }
+        if (S_ISDIR(st.st_mode))
+            return copy_dir(src, dst, st);
+        if (S_ISLNK(st.st_mode))
+        {
+            // st_size is 0 for some pseudo-filesystem links.
+            std::string target(st.st_size > 0 ? static_cast<size_t>(st.st_size) + 1 : PATH_MAX, '\0');
+            ssize_t n = readlink(src.c_str(), target.data(), target.size());
+            if (n < 0)
+                return report("readlink", src);
+            target.resize(static_cast<size_t>(n));
+            if (symlink(target.c_str(), dst.c_str()) != 0)
+                return report("symlink", dst);
+            return true;
+        }
+        if (mknod(dst.c_str(), st.st_mode, st.st_rdev) != 0)
+            return report("mknod", dst);
+        return true;
+    }
+
+    // Waits for queued files and fixes up directories. Returns false if any
+    // copy failed.
+    bool finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        ready.notify_all();
+        for (std::thread& t : workers)
+            t.join();
+        workers.clear();
+        while (!queue.empty())
+        {
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            run(job);
+        }
+        for (auto it = dirs.rbegin(); it != dirs.rend(); ++it)
+        {
+            if (!preserve)
+            {
+                if ((it->st.st_mode & S_IRWXU) != S_IRWXU && chmod(it->dst.c_str(), it->st.st_mode & 07777) != 0)
+                    report("chmod", it->dst);
+                continue;
+            }
+            FD fd(open(it->dst.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (fd)
+                copy_attributes(fd.get(), it->st);
+        }
+        dirs.clear();
+        return ok;
+    }
+
+  private:
+    struct Job
+    {
+        std::string src;
+        std::string dst;
+        struct stat st;
+    };
+
+    std::string_view prog;
+    bool preserve;
+    bool ok{true};
+    bool done{false};
+    std::vector<std::thread> workers{};
+    std::deque<Job> queue{};
+    std::vector<Job> dirs{};
+    std::mutex mutex{};
+    std::mutex error_mutex{}; // also taken by the walking thread
+    std::condition_variable ready{};
+
+    bool copy_dir(const std::string& src, const std::string& dst, const struct stat& st)
+    {
+        // Owner rwx until finish() so the tree can be filled in.
+        if (mkdir(dst.c_str(), (st.st_mode & 07777) | S_IRWXU) != 0)
+        {
+            struct stat existing{};
+            if (errno != EEXIST || stat(dst.c_str(), &existing) != 0 || !S_ISDIR(existing.st_mode))
+                return report("mkdir", dst);
+        }
+        dirs.push_back({src, dst, st});
+        std::vector<std::string> names;
+        if (!list_dir(src.c_str(), names))
+            return report("read directory", src);
+        std::sort(names.begin(), names.end());
+        bool all = true;
+        for (const std::string& name : names)
+        {
+            std::string from = join_path(src, name);
+            struct stat child{};
+            if (lstat(from.c_str(), &child) != 0)
+                all = report("stat", from);
+            else if (!copy(from, join_path(dst, name), child))
+                all = false;
+        }
+        return all;
+    }
+
+    void submit(Job job)
+    {
+        if (workers.empty())
+        {
+            run(job);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return done || !queue.empty(); });
+            if (queue.empty())
+                return;
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            run(job);
+        }
+    }
+
+    void run(const Job& job)
+    {
+        Method method = Method::Clone;
+        if (!copy_file(job.src.c_str(), job.dst.c_str(), job.st, preserve, method))
+            report("copy", job.src);
+    }
+
+    bool report(std::string_view action, std::string_view path)
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        print_errno(prog, action, path);
+        ok = false;
+        return false;
+    }
+};
+
+// rm -r for mv's cross-device fallback.
+inline bool remove_tree(std::string_view prog, const std::string& path)
+{
+    struct stat st{};
+    if (lstat(path.c_str(), &st) != 0)
+    {
+        print_errno(prog, "stat", path);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        if (unlink(path.c_str()) == 0)
+            return true;
+        print_errno(prog, "unlink", path);
+        return false;
+    }
+    std::vector<std::string> names;
+    if (!list_dir(path.c_str(), names))
+    {
+        print_errno(prog, "read directory", path);
+        return false;
+    }
+    bool all = true;
+    for (const std::string& name : names)
+        all = remove_tree(prog, join_path(path, name)) && all;
+    if (all && rmdir(path.c_str()) != 0)
+    {
+        print_errno(prog, "rmdir", path);
+        return false;
+    }
+    return all;
+}
+
+#endif // COPY_HPP
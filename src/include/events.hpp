@@ -0,0 +1,151 @@
+#ifndef EVENTS_HPP
+#define EVENTS_HPP
+
+#include <csignal>
+#include <cstdint>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "syscall.hpp"
+#include "util.hpp"
+
+constexpr int MAX_EVENTS = 16;
+
+// What an epoll event refers to. The source sits in the high half of
+// epoll_data.u64 and an id (job number, ...) in the low half.
+enum class Source : uint32_t
+{
+    Input,
+    Signal,
+    Child,
+    Timer,
+    Service, // init's restart timer
+};
+
+// One epoll instance for terminal input, a signalfd and any number of
+// pidfds and timerfds, so the caller blocks in exactly one place. All
+// descriptors are close-on-exec; children must restore old_mask.
+struct EventLoop
+{
+    FD epoll{};
+    FD signals{};
+    sigset_t mask{};
+    sigset_t old_mask{};
+    bool input_pollable{false}; // false when stdin is a regular file
+    epoll_event events[MAX_EVENTS]{};
+
+    // Blocks sigs and routes them to the signalfd.
+    bool init(const int* sigs, size_t count)
+    {
+        sigemptyset(&mask);
+        for (size_t i = 0; i < count; ++i)
+            sigaddset(&mask, sigs[i]);
+        if (sigprocmask(SIG_BLOCK, &mask, &old_mask) != 0)
+            return false;
+        return reopen();
+    }
+
+    // Fresh epoll and signalfd instances with the same mask. A forked child
+    // that keeps using the loop needs this: the inherited descriptors share
+    // state with the parent's.
+    bool reopen()
+    {
+        epoll = FD(epoll_create1(EPOLL_CLOEXEC));
+        signals = FD(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC));
+        if (!epoll || !signals)
+            return false;
+        input_pollable = add(STDIN_FILENO, Source::Input, 0);
+        return add(signals.get(), Source::Signal, 0);
+    }
+
+    bool add(int fd, Source source, uint32_t id)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = (static_cast<uint64_t>(source) << 32) | id;
+        return epoll_ctl(epoll.get(), EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    void remove(int fd)
+    {
+        epoll_ctl(epoll.get(), EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Stops (or resumes) reporting stdin, e.g. while a foreground command
+    // owns the terminal and typeahead must stay queued for the prompt.
+    void watch_input(bool on)
+    {
+        if (!input_pollable)
+            return;
+        epoll_event ev{};
+        ev.events = on ? EPOLLIN : 0;
+        ev.data.u64 = static_cast<uint64_t>(Source::Input) << 32;
+        epoll_ctl(epoll.get(), EPOLL_CTL_MOD, STDIN_FILENO, &ev);
+    }
+
+    // Returns the number of ready events (0 on timeout or EINTR).
+    int wait(int timeout_ms)
+    {
+        int n = epoll_wait(epoll.get(), events, MAX_EVENTS, timeout_ms);
+        return n < 0 ? 0 : n;
+    }
+
+    static Source source(const epoll_event& ev)
+    {
+        return static_cast<Source>(ev.data.u64 >> 32);
+    }
+
+    static uint32_t id(const epoll_event& ev)
+    {
+        return static_cast<uint32_t>(ev.data.u64);
+    }
+
+    // Calls fn(signo) for each queued signal.
+    template <typename F> void drain_signals(F&& fn)
+    {
+        signalfd_siginfo info[8];
+        while (true)
+        {
+            auto r = sys::read(signals.get(), info, sizeof info);
+            if (!r || r.value() <= 0)
+                return;
+            for (long i = 0; i < r.value() / static_cast<long>(sizeof info[0]); ++i)
+                fn(static_cast<int>(info[i].ssi_signo));
+        }
+    }
+};
+
+// One-shot CLOCK_MONOTONIC timer that fires after ns.
+inline void arm_timer(int fd, int64_t ns)
+{
+    itimerspec spec{};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    timerfd_settime(fd, 0, &spec, nullptr);
+}
+
+inline FD make_timer(int64_t ns)
+{
+    FD fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (fd)
+        arm_timer(fd.get(), ns);
+    return fd;
+}
+
+inline void clear_timer(int fd)
+{
+    uint64_t expirations;
+    sys::read(fd, &expirations, sizeof expirations);
+}
+
+// A pidfd for the child, or an empty FD on kernels before 5.3; callers then
+// fall back to SIGCHLD.
+inline FD open_pidfd(pid_t pid)
+{
+    auto r = sys::pidfd_open(pid, 0);
+    return FD(r ? r.value() : -1);
+}
+
+#endif // EVENTS_HPP
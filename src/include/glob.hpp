@@ -0,0 +1,380 @@
+#ifndef GLOB_HPP
+#define GLOB_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+#include "arena.hpp"
+#include "util.hpp"
+
+inline bool has_glob_meta(std::string_view s)
+{
+    return s.find_first_of("*?[") != std::string_view::npos;
+}
+
+// One path component compiled into a flat op list. Most real patterns are
+// prefix*suffix ("*.log", "core.*"), which match with two memcmps; anything
+// else runs a single-star backtracking matcher over the ops.
+struct GlobMatcher
+{
+    enum Kind : uint8_t
+    {
+        Lit,
+        One,
+        Star,
+        Set,
+    };
+
+    struct Op
+    {
+        Kind kind;
+        bool negate;
+        uint32_t off; // Lit: into lits; Set: into sets
+        uint32_t len;
+    };
+
+    std::vector<Op> ops{};
+    std::string lits{};
+    std::vector<uint64_t> sets{}; // 4 words (256 bits) per Set op
+    Op prefix{Lit, false, 0, 0};  // leading literal, checked first
+    Op suffix{Lit, false, 0, 0};  // trailing literal after a '*'
+    bool simple{false};
+    bool wants_dot{false};
+
+    void compile(std::string_view pat)
+    {
+        ops.clear();
+        lits.clear();
+        sets.clear();
+
+        wants_dot = pat.size() > 0 && (pat[0] == '.' || (pat[0] == '\\' && pat.size() > 1 && pat[1] == '.'));
+        for (size_t i = 0; i < pat.size();)
+        {
+            char c = pat[i];
+            if (c == '*')
+            {
+                if (ops.empty() || ops.back().kind != Star)
+                    ops.push_back({Star, false, 0, 0});
+                i++;
+            }
+            else if (c == '?')
+            {
+                ops.push_back({One, false, 0, 0});
+                i++;
+            }
+            else if (c == '[' && compile_set(pat, i))
+            {
+            }
+            else
+            {
+                if (c == '\\' && i + 1 < pat.size())
+                    c = pat[++i];
+                i++;
+                if (ops.empty() || ops.back().kind != Lit)
+                    ops.push_back({Lit, false, static_cast<uint32_t>(lits.size()), 0});
+                lits += c;
+                ops.back().len++;
+            }
+        }
+
+        prefix = {Lit, false, 0, 0};
+        suffix = {Lit, false, 0, 0};
+        bool has_star = false;
+        for (const Op& op : ops)
+            has_star |= op.kind == Star;
+        if (!ops.empty() && ops.front().kind == Lit)
+            prefix = ops.front();
+        if (has_star && ops.back().kind == Lit)
+            suffix = ops.back();
+        simple = has_star && ops.size() == 1u + (prefix.len > 0) + (suffix.len > 0);
+    }
+
+    bool match(std::string_view name) const
+    {
+        if (name.empty() || (name[0] == '.' && !wants_dot))
+            return false;
+        if (name.size() < prefix.len + suffix.len)
+            return false;
+        if (memcmp(name.data(), lits.data() + prefix.off, prefix.len) != 0)
+            return false;
+        if (memcmp(name.data() + name.size() - suffix.len, lits.data() + suffix.off, suffix.len) != 0)
+            return false;
+        if (simple)
+            return true;
+
+        size_t oi = 0, ni = 0;
+        size_t star_op = SIZE_MAX, star_name = 0;
+        while (true)
+        {
+            if (oi < ops.size())
+            {
+                const Op& op = ops[oi];
+                if (op.kind == Star)
+                {
+                    star_op = oi++;
+                    star_name = ni;
+                    continue;
+                }
+                if (step(op, name, ni))
+                {
+                    oi++;
+                    continue;
+                }
+            }
+            else if (ni == name.size())
+            {
+                return true;
+            }
+            if (star_op == SIZE_MAX || star_name >= name.size())
+                return false;
+            oi = star_op + 1;
+            ni = ++star_name;
+        }
+    }
+
+  private:
+    bool step(const Op& op, std::string_view name, size_t& ni) const
+    {
+        switch (op.kind)
+        {
+        case Lit:
+            if (name.size() - ni < op.len || memcmp(name.data() + ni, lits.data() + op.off, op.len) != 0)
+                return false;
+            ni += op.len;
+            return true;
+        case One:
+            if (ni >= name.size())
+                return false;
+            ni++;
+            return true;
+        case Set: {
+            if (ni >= name.size())
+                return false;
+            unsigned char c = static_cast<unsigned char>(name[ni]);
+            bool in = (sets[op.off + c / 64] >> (c % 64)) & 1;
+            if (in == op.negate)
+                return false;
+            ni++;
+            return true;
+        }
+        case Star:
+            break;
+        }
+        return false;
+    }
+
+    // [abc], [a-z], [!x] / [^x]. Returns false (and leaves i) if unterminated,
+    // in which case '[' is an ordinary character.
+    bool compile_set(std::string_view pat, size_t& i)
+    {
+        size_t j = i + 1;
+        bool negate = j < pat.size() && (pat[j] == '!' || pat[j] == '^');
+        if (negate)
+            j++;
+        size_t first = j;
+        uint64_t bits[4]{};
+        while (j < pat.size() && (pat[j] != ']' || j == first))
+        {
+            unsigned char lo = static_cast<unsigned char>(pat[j]);
+            if (lo == '\\' && j + 1 < pat.size())
+                lo = static_cast<unsigned char>(pat[++j]);
+            unsigned char hi = lo;
+            if (j + 2 < pat.size() && pat[j + 1] == '-' && pat[j + 2] != ']')
+            {
+                hi = static_cast<unsigned char>(pat[j + 2]);
+                j += 2;
+            }
+            for (unsigned c = lo; c <= hi; ++c)
+                bits[c / 64] |= uint64_t{1} << (c % 64);
+            j++;
+        }
+        if (j >= pat.size())
+            return false;
+        ops.push_back({Set, negate, static_cast<uint32_t>(sets.size()), 0});
+        sets.insert(sets.end(), bits, bits + 4);
+        i = j + 1;
+        return true;
+    }
+};
+
+// Pathname expansion. The pattern is split at '/', runs of literal
+// components are opened directly with openat, and only directories that
+// matched so far are read (getdents64). d_type decides which entries to
+// descend into, so nothing is stat'ed; symlinks and DT_UNKNOWN are simply
+// tried with O_DIRECTORY. Matches are carved from the arena and sorted.
+struct Glob
+{
+    struct Part
+    {
+        bool literal;
+        std::string text; // unescaped path for literal parts, pattern otherwise
+        GlobMatcher matcher;
+    };
+
+    std::vector<Part> parts{};
+    size_t nparts{0};
+    std::string path{};
+    Arena* arena{nullptr};
+    std::vector<char*>* out{nullptr};
+
+    // Appends the sorted matches of pattern (backslash-escaped) to results.
+    // Returns the number of matches.
+    size_t expand(std::string_view pattern, Arena& a, std::vector<char*>& results)
+    {
+        arena = &a;
+        out = &results;
+        split(pattern);
+
+        bool absolute = !pattern.empty() && pattern[0] == '/';
+        path.assign(absolute ? "/" : "");
+        FD start(open(absolute ? "/" : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (!start)
+            return 0;
+
+        size_t before = results.size();
+        walk(start.get(), 0);
+        std::sort(results.begin() + static_cast<ptrdiff_t>(before), results.end(),
+                  [](const char* x, const char* y) { return strcmp(x, y) < 0; });
+        return results.size() - before;
+    }
+
+  private:
+    Part& next_part()
+    {
+        if (nparts == parts.size())
+            parts.emplace_back();
+        return parts[nparts++];
+    }
+
+    void split(std::string_view pattern)
+    {
+        nparts = 0;
+        size_t i = 0;
+        while (i <= pattern.size())
+        {
+            size_t end = i;
+            while (end < pattern.size() && pattern[end] != '/')
+                end += (pattern[end] == '\\' && end + 1 < pattern.size()) ? 2 : 1;
+            std::string_view comp = pattern.substr(i, end - i);
+            bool trailing = end >= pattern.size();
+
+            if (!comp.empty() || (trailing && nparts > 0 && i > 0))
+            {
+                if (has_glob_meta(comp))
+                {
+                    Part& p = next_part();
+                    p.literal = false;
+                    p.text.assign(comp);
+                    p.matcher.compile(p.text);
+                }
+                else
+                {
+                    // Merge consecutive literal components into one openat path.
+                    bool merge = nparts > 0 && parts[nparts - 1].literal && !comp.empty();
+                    Part& p = merge ? parts[nparts - 1] : next_part();
+                    if (!merge)
+                    {
+                        p.literal = true;
+                        p.text.clear();
+                    }
+                    else
+                    {
+                        p.text += '/';
+                    }
+                    for (size_t k = 0; k < comp.size(); ++k)
+                    {
+                        if (comp[k] == '\\' && k + 1 < comp.size())
+                            k++;
+                        p.text += comp[k];
+                    }
+                }
+            }
+            i = end + 1;
+        }
+    }
+
+    void emit()
+    {
+        out->push_back(arena->str(path));
+    }
+
+    void walk(int dirfd, size_t idx)
+    {
+        if (idx == nparts)
+        {
+            emit();
+            return;
+        }
+
+        const Part& part = parts[idx];
+        size_t mark = path.size();
+        bool last = idx + 1 == nparts;
+
+        if (part.literal)
+        {
+            if (part.text.empty()) // trailing '/': the previous match was a directory
+            {
+                path += '/';
+                emit();
+            }
+            else if (last)
+            {
+                struct stat st{};
+                if (fstatat(dirfd, part.text.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    append(part.text);
+                    emit();
+                }
+            }
+            else
+            {
+                FD sub(openat(dirfd, part.text.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+                if (sub)
+                {
+                    append(part.text);
+                    walk(sub.get(), idx + 1);
+                }
+            }
+            path.resize(mark);
+            return;
+        }
+
+        for_each_dirent(dirfd, [&](std::string_view name, unsigned char type) {
+            if (!part.matcher.match(name))
+                return;
+            if (last)
+            {
+                append(name);
+                emit();
+                path.resize(mark);
+                return;
+            }
+            if (type != DT_DIR && type != DT_LNK && type != DT_UNKNOWN)
+                return;
+            char buf[256];
+            memcpy(buf, name.data(), name.size());
+            buf[name.size()] = '\0';
+            FD sub(openat(dirfd, buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (!sub)
+                return;
+            append(name);
+            walk(sub.get(), idx + 1);
+            path.resize(mark);
+        });
+    }
+
+    void append(std::string_view name)
+    {
+        if (!path.empty() && path.back() != '/')
+            path += '/';
+        path.append(name);
+    }
+};
+
+#endif // GLOB_HPP
@@ -0,0 +1,198 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util.hpp"
+
+constexpr size_t HISTORY_CAPACITY = 100000;     // entries kept in memory
+constexpr size_t HISTORY_ARENA_SIZE = 8u << 20; // bytes of command text
+constexpr const char* HISTORY_FILE_NAME = ".sh_history";
+
+// Command history as a fixed-capacity ring of (offset, length) records over
+// a ring of text bytes. Adding a command is O(1): the oldest entries are
+// dropped when either ring runs out of room, and nothing is ever moved. Both
+// rings are allocated once and untouched pages cost nothing until used.
+struct History
+{
+    struct Entry
+    {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    std::unique_ptr<char[]> text{new char[HISTORY_ARENA_SIZE]};
+    std::unique_ptr<Entry[]> ring{new Entry[HISTORY_CAPACITY]};
+    size_t start{0}; // ring slot of the oldest entry
+    size_t count{0};
+    size_t write{0}; // next free byte in text
+    FD file{};
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // 0 is the oldest entry.
+    std::string_view at(size_t i) const
+    {
+        const Entry& e = ring[(start + i) % HISTORY_CAPACITY];
+        return {text.get() + e.off, e.len};
+    }
+
+    // Adds a command unless it repeats the newest entry. Returns whether it
+    // was stored.
+    bool add(std::string_view cmd)
+    {
+        if (cmd.empty() || cmd.size() > HISTORY_ARENA_SIZE / 4)
+            return false;
+        if (count > 0 && at(count - 1) == cmd)
+            return false;
+
+        if (write + cmd.size() > HISTORY_ARENA_SIZE)
+        {
+            // Whatever sits past the write position is the oldest text.
+            while (count > 0 && oldest().off >= write)
+                drop_oldest();
+            write = 0;
+        }
+        while (count > 0 && oldest().off < write + cmd.size() && write < oldest().off + oldest().len)
+            drop_oldest();
+        if (count == HISTORY_CAPACITY)
+            drop_oldest();
+
+        memcpy(text.get() + write, cmd.data(), cmd.size());
+        Entry e{static_cast<uint32_t>(write), static_cast<uint32_t>(cmd.size())};
+        ring[(start + count) % HISTORY_CAPACITY] = e;
+        count++;
+        write += cmd.size();
+        return true;
+    }
+
+    // Index of the newest entry before `before` containing needle, or
+    // SIZE_MAX.
+    size_t search(std::string_view needle, size_t before) const
+    {
+        while (before > 0)
+        {
+            --before;
+            if (at(before).find(needle) != std::string_view::npos)
+                return before;
+        }
+        return SIZE_MAX;
+    }
+
+    // Loads the history file with one mmap and keeps it open for appending.
+    // Files that grew well past the in-memory capacity are rewritten.
+    void load(const std::string& path)
+    {
+        file = FD(open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600));
+        if (!file)
+            return;
+        struct stat st{};
+        if (fstat(file.get(), &st) != 0 || st.st_size == 0)
+            return;
+
+        size_t len = static_cast<size_t>(st.st_size);
+        void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, file.get(), 0);
+        if (map == MAP_FAILED)
+            return;
+        std::string_view data(static_cast<const char*>(map), len);
+
+        // Only the newest HISTORY_CAPACITY lines can survive, so start there.
+        size_t begin = data.size();
+        size_t lines = 0;
+        while (begin > 0 && lines <= HISTORY_CAPACITY)
+        {
+            begin = data.rfind('\n', begin - 1);
+            if (begin == std::string_view::npos)
+            {
+                begin = 0;
+                break;
+            }
+            lines++;
+        }
+        bool oversized = begin > len / 2;
+
+        while (begin < data.size())
+        {
+            size_t nl = data.find('\n', begin);
+            if (nl == std::string_view::npos)
+                nl = data.size();
+            add(data.substr(begin, nl - begin));
+            begin = nl + 1;
+        }
+        munmap(map, len);
+
+        if (oversized)
+            rewrite(path);
+    }
+
+    // One write per command so concurrent shells interleave whole lines.
+    void persist(std::string_view cmd)
+    {
+        if (!file || cmd.find('\n') != std::string_view::npos)
+            return;
+        std::string line{};
+        line.reserve(cmd.size() + 1);
+        line.append(cmd);
+        line += '\n';
+        write_all(file.get(), line.data(), line.size());
+    }
+
+  private:
+    const Entry& oldest() const
+    {
+        return ring[start];
+    }
+
+    void drop_oldest()
+    {
+        start = (start + 1) % HISTORY_CAPACITY;
+        count--;
+    }
+
+    void rewrite(const std::string& path)
+    {
+        std::string tmp = path + ".tmp";
+        FD out(open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+        if (!out)
+            return;
+        std::string buf{};
+        for (size_t i = 0; i < count; ++i)
+        {
+            buf.append(at(i));
+            buf += '\n';
+            if (buf.size() >= 64 * 1024 || i + 1 == count)
+            {
+                if (!write_all(out.get(), buf.data(), buf.size()))
+                    return;
+                buf.clear();
+            }
+        }
+        if (rename(tmp.c_str(), path.c_str()) == 0)
+            file = FD(open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    }
+};
+
+// $HISTFILE, else ~/.sh_history, else /.sh_history (init has no HOME).
+inline std::string history_path()
+{
+    if (const char* p = getenv("HISTFILE"))
+        return p;
+    std::string path = getenv("HOME") ? getenv("HOME") : "";
+    path += '/';
+    path += HISTORY_FILE_NAME;
+    return path;
+}
+
+#endif // HISTORY_HPP
@@ -0,0 +1,278 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+#include "utf8.hpp"
+
+constexpr size_t INPUT_BUFFER_SIZE = 64 * 1024;
+constexpr int32_t ESCAPE_TIMEOUT_MS = 25;
+constexpr size_t MAX_ESCAPE_LEN = 32;
+
+// Decoded keys. ASCII bytes are returned unchanged and UTF-8 sequences as
+// their code point; named keys sit above the Unicode range so callers can
+// switch on a single int32_t.
+enum Key : int32_t
+{
+    KEY_NONE = -1,
+    KEY_ESCAPE = 0x1b,
+    KEY_UP = 0x110000,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
+    KEY_CTRL_RIGHT,
+    KEY_CTRL_LEFT,
+    KEY_PASTE_START,
+    KEY_PASTE_END,
+    KEY_ALT = 0x200000, // or'ed with the byte that followed a lone ESC
+};
+
+constexpr const char* BRACKETED_PASTE_ON = "\x1b[?2004h";
+constexpr const char* BRACKETED_PASTE_OFF = "\x1b[?2004l";
+
+// Buffered terminal input. fill() blocks once and then takes everything the
+// tty has queued, so a paste arrives in a handful of reads and the caller can
+// apply every key before redrawing.
+struct InputReader
+{
+    int fd{STDIN_FILENO};
+    size_t head{0};
+    size_t tail{0};
+    bool pasting{false}; // inside a bracketed paste; keys are literal text
+    char buf[INPUT_BUFFER_SIZE];
+
+    bool pending() const
+    {
+        return head < tail;
+    }
+
+    // Returns the number of bytes added, 0 on EOF and -1 with errno set on
+    // error (EINTR included).
+    ssize_t fill()
+    {
+        compact();
+        ssize_t r = ::read(fd, buf + tail, sizeof buf - tail);
+        if (r < -1) // the raw syscall stubs in sys.S return -errno directly
+        {
+            errno = static_cast<int>(-r);
+            r = -1;
+        }
+        if (r > 0)
+            tail += static_cast<size_t>(r);
+        return r;
+    }
+
+    int32_t next_key()
+    {
+        if (!pending())
+            return KEY_NONE;
+
+        unsigned char c = static_cast<unsigned char>(buf[head]);
+        if (c >= 0x80)
+            return next_utf8();
+        if (c != '\x1b')
+        {
+            head++;
+            return c;
+        }
+        if (pasting)
+        {
+            static constexpr char PASTE_END[] = "\x1b[201~";
+            if (have_prefix(PASTE_END, sizeof PASTE_END - 1))
+            {
+                head += sizeof PASTE_END - 1;
+                pasting = false;
+                return KEY_PASTE_END;
+            }
+            head++;
+            return c;
+        }
+        return parse_escape();
+    }
+
+  private:
+    // A multibyte character, completed first if a read split it. Invalid
+    // bytes are dropped one at a time.
+    int32_t next_utf8()
+    {
+        size_t n = utf8::sequence_length(static_cast<unsigned char>(buf[head]));
+        while (tail - head < n && wait_more())
+        {
+        }
+        uint32_t cp;
+        size_t k = utf8::decode(buf + head, buf + tail, cp);
+        head += k ? k : 1;
+        return k ? static_cast<int32_t>(cp) : KEY_NONE;
+    }
+
+    void compact()
+    {
+        if (head == tail)
+        {
+            head = tail = 0;
+        }
+        else if (head > 0 && tail == sizeof buf)
+        {
+            memmove(buf, buf + head, tail - head);
+            tail -= head;
+            head = 0;
+        }
+    }
+
+    // Waits briefly for the rest of a split escape or UTF-8 sequence.
+    bool wait_more()
+    {
+        if (tail == sizeof buf)
+            compact();
+        if (tail == sizeof buf)
+            return false;
+        pollfd p{fd, POLLIN, 0};
+        if (poll(&p, 1, ESCAPE_TIMEOUT_MS) <= 0)
+            return false;
+        ssize_t r = ::read(fd, buf + tail, sizeof buf - tail);
+        if (r <= 0)
+            return false;
+        tail += static_cast<size_t>(r);
+        return true;
+    }
+
+    bool have_prefix(const char* seq, size_t len)
+    {
+        while (true)
+        {
+            size_t avail = tail - head;
+            size_t n = avail < len ? avail : len;
+            if (memcmp(buf + head, seq, n) != 0)
+                return false;
+            if (n == len)
+                return true;
+            if (!wait_more())
+                return false;
+        }
+    }
+
+    int32_t parse_escape()
+    {
+        if (tail - head < 2 && !wait_more())
+        {
+            head++;
+            return KEY_ESCAPE;
+        }
+
+        char kind = buf[head + 1];
+        if (kind == 'O')
+        {
+            if (tail - head < 3 && !wait_more())
+            {
+                head += 2;
+                return KEY_ALT | 'O';
+            }
+            char f = buf[head + 2];
+            head += 3;
+            switch (f)
+            {
+            case 'A':
+                return KEY_UP;
+            case 'B':
+                return KEY_DOWN;
+            case 'C':
+                return KEY_RIGHT;
+            case 'D':
+                return KEY_LEFT;
+            case 'H':
+                return KEY_HOME;
+            case 'F':
+                return KEY_END;
+            }
+            return KEY_NONE;
+        }
+        if (kind != '[')
+        {
+            head += 2;
+            return KEY_ALT | static_cast<unsigned char>(kind);
+        }
+
+        // CSI: ESC [ params final
+        size_t off = 2; // relative to head, which wait_more() may move
+        uint32_t params[2]{0, 0};
+        size_t nparams = 0;
+        while (true)
+        {
+            if (head + off == tail && !wait_more())
+            {
+                head = tail; // truncated sequence, drop it
+                return KEY_NONE;
+            }
+            char ch = buf[head + off];
+            if (ch >= '0' && ch <= '9')
+            {
+                if (nparams < 2)
+                    params[nparams] = params[nparams] * 10 + static_cast<uint32_t>(ch - '0');
+            }
+            else if (ch == ';')
+            {
+                nparams++;
+            }
+            else if (ch >= 0x40 && ch <= 0x7e)
+            {
+                head += off + 1;
+                bool modified = nparams >= 1 && (params[1] == 5 || params[1] == 3);
+                switch (ch)
+                {
+                case 'A':
+                    return KEY_UP;
+                case 'B':
+                    return KEY_DOWN;
+                case 'C':
+                    return modified ? KEY_CTRL_RIGHT : KEY_RIGHT;
+                case 'D':
+                    return modified ? KEY_CTRL_LEFT : KEY_LEFT;
+                case 'H':
+                    return KEY_HOME;
+                case 'F':
+                    return KEY_END;
+                case '~':
+                    switch (params[0])
+                    {
+                    case 1:
+                    case 7:
+                        return KEY_HOME;
+                    case 4:
+                    case 8:
+                        return KEY_END;
+                    case 3:
+                        return KEY_DELETE;
+                    case 5:
+                        return KEY_PAGE_UP;
+                    case 6:
+                        return KEY_PAGE_DOWN;
+                    case 200:
+                        pasting = true;
+                        return KEY_PASTE_START;
+                    case 201:
+                        return KEY_PASTE_END;
+                    }
+                    return KEY_NONE;
+                }
+                return KEY_NONE;
+            }
+            if (++off > MAX_ESCAPE_LEN)
+            {
+                head += off;
+                return KEY_NONE;
+            }
+        }
+    }
+};
+
+#endif // INPUT_HPP
@@ -0,0 +1,318 @@
+#ifndef LINEEDIT_HPP
+#define LINEEDIT_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "utf8.hpp"
+#include "util.hpp"
+
+inline size_t terminal_columns()
+{
+    winsize ws{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+        return 80;
+    return ws.ws_col;
+}
+
+// Editable command line: the text, the cursor and a one-entry kill buffer.
+// The cursor moves over whole characters, combining marks included.
+struct LineEditor
+{
+    std::string buf{};
+    size_t pos{0};
+    std::string killed{};
+
+    void clear()
+    {
+        buf.clear();
+        pos = 0;
+    }
+
+    void set(std::string_view text)
+    {
+        buf.assign(text);
+        pos = buf.size();
+    }
+
+    void insert(std::string_view text)
+    {
+        buf.insert(pos, text);
+        pos += text.size();
+    }
+
+    void left()
+    {
+        pos = utf8::prev(buf, pos);
+    }
+
+    void right()
+    {
+        pos = utf8::next(buf, pos);
+    }
+
+    void home()
+    {
+        pos = 0;
+    }
+
+    void end()
+    {
+        pos = buf.size();
+    }
+
+    // Non-ASCII bytes count as letters, so words in any script move as one.
+    static bool word_char(char c)
+    {
+        auto u = static_cast<unsigned char>(c);
+        return u >= 0x80 || isalnum(u) || c == '_';
+    }
+
+    size_t word_start(size_t from) const
+    {
+        while (from > 0 && !word_char(buf[from - 1]))
+            from--;
+        while (from > 0 && word_char(buf[from - 1]))
+            from--;
+        return from;
+    }
+
+    size_t word_end(size_t from) const
+    {
+        while (from < buf.size() && !word_char(buf[from]))
+            from++;
+        while (from < buf.size() && word_char(buf[from]))
+            from++;
+        return from;
+    }
+
+    void word_left()
+    {
+        pos = word_start(pos);
+    }
+
+    void word_right()
+    {
+        pos = word_end(pos);
+    }
+
+    void backspace()
+    {
+        size_t from = utf8::prev(buf, pos);
+        buf.erase(from, pos - from);
+        pos = from;
+    }
+
+    void del()
+    {
+        buf.erase(pos, utf8::next(buf, pos) - pos);
+    }
+
+    void kill_range(size_t from, size_t to)
+    {
+        killed.assign(buf, from, to - from);
+        buf.erase(from, to - from);
+        pos = from;
+    }
+
+    void kill_to_end()
+    {
+        kill_range(pos, buf.size());
+    }
+
+    void kill_to_start()
+    {
+        kill_range(0, pos);
+    }
+
+    void kill_word_back() // whitespace-delimited, like Ctrl-W in readline
+    {
+        size_t from = pos;
+        while (from > 0 && isspace(static_cast<unsigned char>(buf[from - 1])))
+            from--;
+        while (from > 0 && !isspace(static_cast<unsigned char>(buf[from - 1])))
+            from--;
+        kill_range(from, pos);
+    }
+
+    void kill_word_forward()
+    {
+        kill_range(pos, word_end(pos));
+    }
+
+    void yank()
+    {
+        insert(killed);
+    }
+};
+
+// Keeps a model of what the prompt line currently looks like on the
+// terminal and emits only the difference on each update: cursor moves for
+// pure motion, the changed tail for edits, and a clear-to-end when the line
+// got shorter. Lines longer than the terminal wrap; positions are tracked as
+// cells counted from the start of the prompt, through a column map of the
+// shown text that is only extended past the first changed byte.
+struct LineRenderer
+{
+    std::string shown{};
+    utf8::ColumnMap cells{}; // of shown, wrapped at cols
+    size_t extent{0};        // cells taken by shown
+    std::string text{};      // prompt and line being rendered
+    size_t cursor{0};
+    size_t cols{80};
+    bool fresh{true};
+    bool resized{false}; // set on SIGWINCH; the width is re-read only then
+    std::string out{};
+
+    // Starts a new prompt on the current terminal line.
+    void begin()
+    {
+        forget();
+        cursor = 0;
+        fresh = true;
+    }
+
+    void forget()
+    {
+        shown.clear();
+        cells.build(shown);
+        extent = 0;
+    }
+
+    void move_to(size_t target)
+    {
+        size_t r0 = cursor / cols, c0 = cursor % cols;
+        size_t r1 = target / cols, c1 = target % cols;
+        char seq[32];
+        if (r1 < r0)
+        {
+            std::snprintf(seq, sizeof seq, "\x1b[%zuA", r0 - r1);
+            out += seq;
+        }
+        else if (r1 > r0)
+        {
+            std::snprintf(seq, sizeof seq, "\x1b[%zuB", r1 - r0);
+            out += seq;
+        }
+        if (c1 == 0 && c0 != 0)
+        {
+            out += '\r';
+        }
+        else if (c1 > c0)
+        {
+            std::snprintf(seq, sizeof seq, "\x1b[%zuC", c1 - c0);
+            out += seq;
+        }
+        else if (c1 < c0)
+        {
+            std::snprintf(seq, sizeof seq, "\x1b[%zuD", c0 - c1);
+            out += seq;
+        }
+        cursor = target;
+    }
+
+    void render(std::string_view prompt, std::string_view line, size_t pos)
+    {
+        out.clear();
+
+        size_t width = fresh || resized ? terminal_columns() : cols;
+        resized = false;
+        if (fresh)
+        {
+            out += "\r\x1b[K";
+            cols = width;
+            fresh = false;
+        }
+        else if (width != cols)
+        {
+            // The old layout no longer applies; repaint from the first row.
+            move_to(0);
+            out += "\r\x1b[J";
+            forget();
+            cursor = 0;
+            cols = width;
+        }
+
+        text.assign(prompt);
+        text.append(line);
+        size_t same = 0;
+        while (same < shown.size() && same < text.size() && shown[same] == text[same])
+            same++;
+        auto in = [](std::string_view s, size_t i) { return i < s.size() && utf8::is_continuation(s[i]); };
+        auto mark = [](std::string_view s, size_t i) {
+            return i < s.size() && static_cast<unsigned char>(s[i]) >= 0x80 && utf8::char_width(s, i) == 0;
+        };
+        if (same < std::max(text.size(), shown.size()))
+        {
+            // Redraw from a character start, and from the character a mark
+            // was added to or removed from.
+            while (same > 0 && (in(text, same) || in(shown, same)))
+                same--;
+            if (mark(text, same) || mark(shown, same))
+                same = utf8::prev(text, same);
+            cells.build(text, cols, same);
+        }
+        size_t total = cells.columns();
+
+        if (same < text.size())
+        {
+            // Start right after the previous character: a wide character
+            // moved to the next row leaves a cell to blank at the row end.
+            size_t start = 0;
+            if (same > 0)
+            {
+                size_t j = utf8::prev_char(text, same);
+                start = cells.column(j) + utf8::char_width(text, j);
+            }
+            move_to(start);
+            out.append(cells.column(same) - start, ' ');
+            utf8::append_display(out, std::string_view(text).substr(same));
+            cursor = total;
+            // Leave the terminal's pending-wrap state so the model holds.
+            if (total % cols == 0)
+                out += "\r\n";
+        }
+        if (total < extent)
+        {
+            move_to(total);
+            out += "\x1b[J";
+        }
+        move_to(cells.column(prompt.size() + pos));
+
+        shown.swap(text);
+        extent = total;
+        if (!out.empty())
+            print(out);
+    }
+
+    // Wipes the edited line so other output can take its place; the next
+    // render starts from scratch.
+    void erase()
+    {
+        out.clear();
+        move_to(0);
+        out += "\r\x1b[J";
+        print(out);
+        begin();
+    }
+
+    // Moves below the edited line so command output starts on a clean row.
+    void finish(std::string_view trailer)
+    {
+        out.clear();
+        move_to(extent);
+        out += trailer;
+        if (!trailer.empty() || extent % cols != 0)
+            out += "\r\n";
+        print(out);
+        begin();
+    }
+};
+
+#endif // LINEEDIT_HPP
@@ -0,0 +1,534 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+#include "arena.hpp"
+#include "glob.hpp"
+
+// Command language:
+//
+//   line     := and_or ((';' | '&' | newline) and_or)* [';' | '&']
+//   and_or   := command (('&&' | '||') command)*
+//   command  := word+
+//
+// '&' runs the simple command before it in the background.
+//
+// Words may mix bare text, '...' (literal), "..." (with $ expansion and
+// \ escapes), \x escapes, $NAME, ${NAME}, $?, $!, $$ and a leading ~. '#'
+// at the start of a word begins a comment.
+//
+// The AST is immutable and expansion happens at execution time, so a parsed
+// line can be cached and run again with different variable values.
+
+enum class SegKind : uint8_t
+{
+    Literal,
+    Var,
+};
+
+struct Segment
+{
+    SegKind kind;
+    bool quoted; // inside quotes or escaped: no field splitting or globbing
+    uint32_t len;
+    const char* text; // literal text, or the variable name
+};
+
+struct Word
+{
+    const Segment* segs;
+    uint32_t count;
+};
+
+enum class Link : uint8_t
+{
+    Seq, // run unconditionally
+    And, // run if the previous command succeeded
+    Or,  // run if the previous command failed
+};
+
+struct Command
+{
+    const Word* words;
+    uint32_t count;
+    Link link;
+    bool background; // terminated by '&'
+};
+
+struct Script
+{
+    const Command* commands;
+    uint32_t count;
+};
+
+// Builds Scripts. The scratch vectors are reused between parses, and the
+// finished AST is copied into the caller's arena.
+struct Parser
+{
+    struct Span
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::vector<Segment> segs{};
+    std::vector<Span> words{};
+    std::vector<Span> commands{};
+    std::vector<Link> links{};
+    std::vector<uint8_t> background{};
+
+    std::string_view src{};
+    size_t i{0};
+    size_t word_seg_start{0};
+    const char* error{nullptr};
+
+    // src must outlive the returned Script (the cache copies it into the
+    // same arena). Returns nullptr and sets error on a syntax error.
+    const Script* parse(std::string_view text, Arena& out)
+    {
+        src = text;
+        i = 0;
+        error = nullptr;
+        segs.clear();
+        words.clear();
+        commands.clear();
+        links.clear();
+        background.clear();
+
+        Link link = Link::Seq;
+        size_t first_word = 0;
+        while (true)
+        {
+            skip_blanks();
+            bool at_end = i >= src.size() || src[i] == '#';
+            char c = at_end ? '\0' : src[i];
+
+            if (at_end || c == ';' || c == '\n' || c == '&' || c == '|')
+            {
+                if (words.size() > first_word)
+                {
+                    uint32_t count = static_cast<uint32_t>(words.size() - first_word);
+                    commands.push_back({static_cast<uint32_t>(first_word), count});
+                    links.push_back(link);
+                    background.push_back(0);
+                    first_word = words.size();
+                }
+                else if (link != Link::Seq)
+                {
+                    return fail(at_end ? "syntax error: unexpected end of line"
+                                       : "syntax error near unexpected operator");
+                }
+                else if (!at_end && c != '\n')
+                {
+                    return fail("syntax error near unexpected operator");
+                }
+                if (at_end)
+                    break;
+
+                if (c == ';' || c == '\n')
+                {
+                    link = Link::Seq;
+                    i++;
+                }
+                else if (src.substr(i, 2) == "&&")
+                {
+                    link = Link::And;
+                    i += 2;
+                }
+                else if (src.substr(i, 2) == "||")
+                {
+                    link = Link::Or;
+                    i += 2;
+                }
+                else if (c == '&')
+                {
+                    // Only the simple command before '&' goes to the background.
+                    background.back() = 1;
+                    link = Link::Seq;
+                    i++;
+                }
+                else
+                {
+                    return fail(c == '|' ? "pipelines are not supported" : "syntax error near unexpected operator");
+                }
+                continue;
+            }
+
+            if (!parse_word())
+                return nullptr;
+        }
+
+        // Copy the finished tree into the arena.
+        Segment* seg_out = out.copy(segs.data(), segs.size());
+        Word* word_out = out.array<Word>(words.size());
+        for (size_t w = 0; w < words.size(); ++w)
+            word_out[w] = {seg_out + words[w].first, words[w].count};
+        Command* cmd_out = out.array<Command>(commands.size());
+        for (size_t k = 0; k < commands.size(); ++k)
+            cmd_out[k] = {word_out + commands[k].first, commands[k].count, links[k], background[k] != 0};
+
+        Script* script = out.array<Script>(1);
+        script->commands = cmd_out;
+        script->count = static_cast<uint32_t>(commands.size());
+        return script;
+    }
+
+  private:
+    const Script* fail(const char* msg)
+    {
+        error = msg;
+        return nullptr;
+    }
+
+    void skip_blanks()
+    {
+        while (i < src.size() && (src[i] == ' ' || src[i] == '\t'))
+            i++;
+    }
+
+    static bool is_name_start(char c)
+    {
+        return isalpha(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    static bool is_name_char(char c)
+    {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    static bool ends_word(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '&' || c == '|';
+    }
+
+    // Appends literal text, extending the previous segment when it is the
+    // same kind of literal and directly adjacent in the source.
+    void literal(size_t from, size_t len, bool quoted)
+    {
+        if (segs.size() > word_seg_start)
+        {
+            Segment& last = segs.back();
+            if (last.kind == SegKind::Literal && last.quoted == quoted && last.text + last.len == src.data() + from)
+            {
+                last.len += static_cast<uint32_t>(len);
+                return;
+            }
+        }
+        segs.push_back({SegKind::Literal, quoted, static_cast<uint32_t>(len), src.data() + from});
+    }
+
+    void variable(const char* name, size_t len, bool quoted)
+    {
+        segs.push_back({SegKind::Var, quoted, static_cast<uint32_t>(len), name});
+    }
+
+    // At '$': reads a parameter reference, or a literal '$'.
+    bool dollar(bool quoted)
+    {
+        size_t start = i++;
+        if (i < src.size() && src[i] == '{')
+        {
+            size_t close = src.find('}', i);
+            if (close == std::string_view::npos)
+            {
+                fail("syntax error: missing '}'");
+                return false;
+            }
+            variable(src.data() + i + 1, close - i - 1, quoted);
+            i = close + 1;
+        }
+        else if (i < src.size() && (src[i] == '?' || src[i] == '$' || src[i] == '!'))
+        {
+            variable(src.data() + i, 1, quoted);
+            i++;
+        }
+        else if (i < src.size() && is_name_start(src[i]))
+        {
+            size_t name = i;
+            while (i < src.size() && is_name_char(src[i]))
+                i++;
+            variable(src.data() + name, i - name, quoted);
+        }
+        else
+        {
+            literal(start, 1, quoted);
+        }
+        return true;
+    }
+
+    bool parse_word()
+    {
+        word_seg_start = segs.size();
+
+        if (src[i] == '~' && (i + 1 == src.size() || src[i + 1] == '/' || ends_word(src[i + 1])))
+        {
+            variable("HOME", 4, true);
+            i++;
+        }
+
+        while (i < src.size() && !ends_word(src[i]))
+        {
+            char c = src[i];
+            if (c == '\'')
+            {
+                size_t close = src.find('\'', i + 1);
+                if (close == std::string_view::npos)
+                {
+                    fail("syntax error: unterminated quote");
+                    return false;
+                }
+                segs.push_back({SegKind::Literal, true, static_cast<uint32_t>(close - i - 1), src.data() + i + 1});
+                i = close + 1;
+            }
+            else if (c == '"')
+            {
+                i++;
+                segs.push_back({SegKind::Literal, true, 0, src.data() + i}); // keeps "" as an empty field
+                while (true)
+                {
+                    if (i >= src.size())
+                    {
+                        fail("syntax error: unterminated quote");
+                        return false;
+                    }
+                    char q = src[i];
+                    if (q == '"')
+                    {
+                        i++;
+                        break;
+                    }
+                    if (q == '\\' && i + 1 < src.size() &&
+                        (src[i + 1] == '$' || src[i + 1] == '"' || src[i + 1] == '\\' || src[i + 1] == '`'))
+                    {
+                        literal(i + 1, 1, true);
+                        i += 2;
+                    }
+                    else if (q == '$')
+                    {
+                        if (!dollar(true))
+                            return false;
+                    }
+                    else
+                    {
+                        literal(i, 1, true);
+                        i++;
+                    }
+                }
+            }
+            else if (c == '\\')
+            {
+                if (i + 1 < src.size())
+                {
+                    if (src[i + 1] != '\n')
+                        literal(i + 1, 1, true);
+                    i += 2;
+                }
+                else
+                {
+                    literal(i, 1, true);
+                    i++;
+                }
+            }
+            else if (c == '$')
+            {
+                if (!dollar(false))
+                    return false;
+            }
+            else
+            {
+                literal(i, 1, false);
+                i++;
+            }
+        }
+
+        words.push_back({static_cast<uint32_t>(word_seg_start), static_cast<uint32_t>(segs.size() - word_seg_start)});
+        return true;
+    }
+};
+
+// Parsed lines keyed by their text. Each slot owns an arena holding a copy
+// of the line and its AST, so re-running a line from history (or the same
+// line in a script) skips lexing and parsing entirely.
+constexpr size_t PARSE_CACHE_SLOTS = 64;
+
+struct ParseCache
+{
+    struct Slot
+    {
+        Arena arena{512};
+        std::string_view key{};
+        const Script* script{nullptr};
+    };
+
+    Slot slots[PARSE_CACHE_SLOTS]{};
+    Parser parser{};
+
+    static uint64_t hash(std::string_view s)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : s)
+        {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    // Returns nullptr and sets error on a syntax error.
+    const Script* get(std::string_view line, const char*& error)
+    {
+        Slot& slot = slots[hash(line) % PARSE_CACHE_SLOTS];
+        if (slot.script && slot.key == line)
+            return slot.script;
+
+        slot.arena.reset();
+        slot.script = nullptr;
+        char* copy = slot.arena.str(line);
+        slot.key = {copy, line.size()};
+        slot.script = parser.parse(slot.key, slot.arena);
+        error = parser.error;
+        return slot.script;
+    }
+};
+
+// Expands words into NUL-terminated fields carved from an arena: parameter
+// expansion, field splitting of unquoted expansions, then pathname
+// expansion of fields with unquoted glob characters.
+struct Expander
+{
+    Arena* arena{nullptr};
+    int last_status{0};
+    int last_background{0}; // $!
+    std::string field{};
+    std::string pattern{}; // field with quoted characters backslash-escaped
+    bool field_live{false}; // the field exists even if empty (quotes)
+    bool globbing{false};   // field has an unquoted *, ? or [
+    char status_buf[16]{};
+    Glob glob{};
+
+    std::string_view lookup(std::string_view name)
+    {
+        if (name == "?")
+        {
+            int n = std::snprintf(status_buf, sizeof status_buf, "%d", last_status);
+            return {status_buf, static_cast<size_t>(n)};
+        }
+        if (name == "!")
+        {
+            if (last_background == 0)
+                return {};
+            int n = std::snprintf(status_buf, sizeof status_buf, "%d", last_background);
+            return {status_buf, static_cast<size_t>(n)};
+        }
+        if (name == "$")
+        {
+            int n = std::snprintf(status_buf, sizeof status_buf, "%d", static_cast<int>(getpid()));
+            return {status_buf, static_cast<size_t>(n)};
+        }
+        // getenv needs a terminated name; names are short.
+        char buf[256];
+        if (name.size() >= sizeof buf)
+            return {};
+        memcpy(buf, name.data(), name.size());
+        buf[name.size()] = '\0';
+        const char* v = getenv(buf);
+        return v ? std::string_view(v) : std::string_view();
+    }
+
+    void add(std::string_view text, bool quoted)
+    {
+        field.append(text);
+        if (quoted)
+        {
+            for (char c : text)
+            {
+                if (c == '*' || c == '?' || c == '[' || c == '\\')
+                    pattern += '\\';
+                pattern += c;
+            }
+        }
+        else
+        {
+            pattern.append(text);
+            globbing |= has_glob_meta(text);
+        }
+    }
+
+    void emit(std::vector<char*>& out)
+    {
+        // A pattern that matches nothing is passed through unchanged.
+        if (globbing && glob.expand(pattern, *arena, out) > 0)
+        {
+        }
+        else if (!field.empty() || field_live)
+        {
+            out.push_back(arena->str(field));
+        }
+        field.clear();
+        pattern.clear();
+        field_live = false;
+        globbing = false;
+    }
+
+    // Expands a word to exactly one field, without splitting (assignments).
+    char* join(const Word& w)
+    {
+        field.clear();
+        for (uint32_t s = 0; s < w.count; ++s)
+        {
+            const Segment& seg = w.segs[s];
+            std::string_view text(seg.text, seg.len);
+            field.append(seg.kind == SegKind::Literal ? text : lookup(text));
+        }
+        return arena->str(field);
+    }
+
+    void expand(const Word& w, std::vector<char*>& out)
+    {
+        field.clear();
+        pattern.clear();
+        field_live = false;
+        globbing = false;
+        for (uint32_t s = 0; s < w.count; ++s)
+        {
+            const Segment& seg = w.segs[s];
+            std::string_view text(seg.text, seg.len);
+            if (seg.kind == SegKind::Literal)
+            {
+                add(text, seg.quoted);
+                field_live |= seg.quoted;
+                continue;
+            }
+
+            std::string_view value = lookup(text);
+            if (seg.quoted)
+            {
+                add(value, true);
+                field_live = true;
+                continue;
+            }
+            while (!value.empty())
+            {
+                size_t blank = value.find_first_of(" \t\n");
+                add(value.substr(0, blank), false);
+                if (blank == std::string_view::npos)
+                    break;
+                if (!field.empty())
+                    emit(out);
+                value.remove_prefix(blank + 1);
+            }
+        }
+        emit(out);
+    }
+};
+
+#endif // PARSER_HPP
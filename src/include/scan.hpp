@@ -0,0 +1,544 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+// Byte-scanning kernels for cat, wc and grep: counting and finding bytes,
+// substrings and word starts in large buffers. Each exists as AVX2, SSE2
+// and scalar code; the widest one the CPU and kernel support is picked with
+// cpuid on first use. Only memcmp is needed from libc, so the freestanding
+// cat can use this too.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+namespace scan
+{
+
+enum class Level : int
+{
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+inline const char* level_name(Level l)
+{
+    switch (l)
+    {
+    case Level::AVX2:
+        return "avx2";
+    case Level::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+// AVX2 needs the CPU flag and the kernel saving YMM state (OSXSAVE/XCR0).
+inline Level detect()
+{
+#ifdef SCAN_X86
+    unsigned a, b, c, d;
+    if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_OSXSAVE) && (c & bit_AVX))
+    {
+        unsigned lo, hi;
+        __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        if ((lo & 0x6) == 0x6 && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2))
+            return Level::AVX2;
+    }
+    return Level::SSE2;
+#else
+    return Level::Scalar;
+#endif
+}
+
+// Constant-initialized so no static constructor or guard is involved.
+inline int g_level = -1;
+
+inline Level level()
+{
+    if (g_level < 0)
+        g_level = static_cast<int>(detect());
+    return static_cast<Level>(g_level);
+}
+
+// Caps the level (benchmarks); anything wider than detect() is clamped.
+inline void set_level(Level l)
+{
+    int best = static_cast<int>(detect());
+    g_level = static_cast<int>(l) < best ? static_cast<int>(l) : best;
+}
+
+inline bool is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Bytes cat -A rewrites: controls (including tab and newline), DEL, non-ASCII.
+inline bool is_special(unsigned char c)
+{
+    return c < 0x20 || c >= 0x7f;
+}
+
+inline char fold(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c;
+}
+
+inline char unfold(char c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - 32) : c;
+}
+
+inline bool equal(const char* a, const char* b, size_t n, bool icase)
+{
+    if (!icase)
+        return std::memcmp(a, b, n) == 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (fold(a[i]) != fold(b[i]))
+            return false;
+    }
+    return true;
+}
+
+namespace detail
+{
+
+inline size_t count_byte_scalar(const char* p, size_t n, char c)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+        k += p[i] == c;
+    return k;
+}
+
+inline const char* find_byte_scalar(const char* p, const char* end, char c)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == c)
+            return p;
+    }
+    return end;
+}
+
+inline const char* find_special_scalar(const char* p, const char* end)
+{
+    for (; p < end; ++p)
+    {
+        if (is_special(static_cast<unsigned char>(*p)))
+            return p;
+    }
+    return end;
+}
+
+// Word starts in p[from, n), given whether p[from - 1] was whitespace.
+inline size_t count_words_scalar(const char* p, size_t from, size_t n, bool prev_space)
+{
+    size_t w = 0;
+    for (size_t i = from; i < n; ++i)
+    {
+        bool space = is_space(static_cast<unsigned char>(p[i]));
+        w += prev_space && !space;
+        prev_space = space;
+    }
+    return w;
+}
+
+inline const char* find_substr_scalar(const char* p, const char* end, std::string_view needle, bool icase)
+{
+    size_t k = needle.size();
+    char lo = fold(needle[0]), hi = icase ? unfold(lo) : needle[0];
+    if (!icase)
+        lo = hi;
+    for (; static_cast<size_t>(end - p) >= k; ++p)
+    {
+        if ((*p == lo || *p == hi) && equal(p + 1, needle.data() + 1, k - 1, icase))
+            return p;
+    }
+    return end;
+}
+
+#ifdef SCAN_X86
+
+// SSE2 is part of x86-64, so these need no target attribute.
+
+inline __m128i space_mask_sse2(__m128i v)
+{
+    __m128i rel = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(rel, _mm_set1_epi8(4)), rel);
+    return _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+inline uint64_t sum_bytes_sse2(__m128i acc)
+{
+    __m128i s = _mm_sad_epu8(acc, _mm_setzero_si128());
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(s)) +
+           static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s)));
+}
+
+// Matches are accumulated as -1 per byte lane, at most 255 blocks at a
+// time, then summed horizontally with psadbw.
+inline size_t count_byte_sse2(const char* p, size_t n, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t total = 0, i = 0;
+    while (n - i >= 16)
+    {
+        __m128i acc = _mm_setzero_si128();
+        size_t blocks = (n - i) / 16 < 255 ? (n - i) / 16 : 255;
+        for (size_t b = 0; b < blocks; ++b, i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        total += sum_bytes_sse2(acc);
+    }
+    return total + count_byte_scalar(p + i, n - i, c);
+}
+
+inline const char* find_byte_sse2(const char* p, const char* end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; end - p >= 64; p += 64)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), needle);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), needle);
+        __m128i x = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), needle);
+        __m128i y = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(x, y))) == 0)
+            continue;
+        uint64_t m = static_cast<uint64_t>(_mm_movemask_epi8(a)) | static_cast<uint64_t>(_mm_movemask_epi8(b)) << 16 |
+                     static_cast<uint64_t>(_mm_movemask_epi8(x)) << 32 |
+                     static_cast<uint64_t>(_mm_movemask_epi8(y)) << 48;
+        return p + __builtin_ctzll(m);
+    }
+    for (; end - p >= 16; p += 16)
+    {
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), needle));
+        if (m)
+            return p + __builtin_ctz(static_cast<unsigned>(m));
+    }
+    return find_byte_scalar(p, end, c);
+}
+
+// Signed compare: bytes >= 0x80 are negative, so "< 0x20" catches them too.
+inline const char* find_special_sse2(const char* p, const char* end)
+{
+    const __m128i space = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7f);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi8(space, v), _mm_cmpeq_epi8(v, del)));
+        if (m)
+            return p + __builtin_ctz(static_cast<unsigned>(m));
+    }
+    return find_special_scalar(p, end);
+}
+
+// A word starts where a non-space byte follows a space; comparing each
+// block with the same block loaded one byte earlier finds all of them.
+inline size_t count_words_sse2(const char* p, size_t n, bool prev_space)
+{
+    if (n == 0)
+        return 0;
+    size_t total = count_words_scalar(p, 0, 1, prev_space), i = 1;
+    while (n - i >= 16)
+    {
+        __m128i acc = _mm_setzero_si128();
+        size_t blocks = (n - i) / 16 < 255 ? (n - i) / 16 : 255;
+        for (size_t b = 0; b < blocks; ++b, i += 16)
+        {
+            __m128i cur = space_mask_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+            __m128i prev = space_mask_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 1)));
+            acc = _mm_sub_epi8(acc, _mm_andnot_si128(cur, prev));
+        }
+        total += sum_bytes_sse2(acc);
+    }
+    return total + count_words_scalar(p, i, n, is_space(static_cast<unsigned char>(p[i - 1])));
+}
+
+// First/last byte filter (both cases with icase), then a full compare of
+// each candidate.
+inline const char* find_substr_sse2(const char* p, const char* end, std::string_view needle, bool icase)
+{
+    size_t k = needle.size();
+    char f = needle[0], l = needle[k - 1];
+    const __m128i f1 = _mm_set1_epi8(icase ? fold(f) : f), f2 = _mm_set1_epi8(icase ? unfold(f) : f);
+    const __m128i l1 = _mm_set1_epi8(icase ? fold(l) : l), l2 = _mm_set1_epi8(icase ? unfold(l) : l);
+    for (; static_cast<size_t>(end - p) >= k - 1 + 16; p += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k - 1));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(a, f1), _mm_cmpeq_epi8(a, f2)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(b, l1), _mm_cmpeq_epi8(b, l2)));
+        for (unsigned m = static_cast<unsigned>(_mm_movemask_epi8(hit)); m; m &= m - 1)
+        {
+            const char* at = p + __builtin_ctz(m);
+            if (equal(at, needle.data(), k, icase))
+                return at;
+        }
+    }
+    return find_substr_scalar(p, end, needle, icase);
+}
+
+#define SCAN_AVX2 __attribute__((target("avx2")))
+
+SCAN_AVX2 inline __m256i space_mask_avx2(__m256i v)
+{
+    __m256i rel = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(rel, _mm256_set1_epi8(4)), rel);
+    return _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+SCAN_AVX2 inline uint64_t sum_bytes_avx2(__m256i acc)
+{
+    __m256i s = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    return static_cast<uint64_t>(_mm256_extract_epi64(s, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(s, 1)) +
+           static_cast<uint64_t>(_mm256_extract_epi64(s, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(s, 3));
+}
+
+SCAN_AVX2 inline size_t count_byte_avx2(const char* p, size_t n, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t total = 0, i = 0;
+    while (n - i >= 64)
+    {
+        __m256i acc1 = _mm256_setzero_si256(), acc2 = _mm256_setzero_si256();
+        size_t blocks = (n - i) / 64 < 255 ? (n - i) / 64 : 255;
+        for (size_t b = 0; b < blocks; ++b, i += 64)
+        {
+            __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32));
+            acc1 = _mm256_sub_epi8(acc1, _mm256_cmpeq_epi8(v1, needle));
+            acc2 = _mm256_sub_epi8(acc2, _mm256_cmpeq_epi8(v2, needle));
+        }
+        total += sum_bytes_avx2(acc1) + sum_bytes_avx2(acc2);
+    }
+    return total + count_byte_sse2(p + i, n - i, c);
+}
+
+SCAN_AVX2 inline const char* find_byte_avx2(const char* p, const char* end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    for (; end - p >= 64; p += 64)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), needle);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), needle);
+        if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)))
+            continue;
+        uint64_t m = static_cast<uint32_t>(_mm256_movemask_epi8(a)) |
+                     static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32;
+        return p + __builtin_ctzll(m);
+    }
+    return find_byte_sse2(p, end, c);
+}
+
+SCAN_AVX2 inline const char* find_special_avx2(const char* p, const char* end)
+{
+    const __m256i space = _mm256_set1_epi8(0x20), del = _mm256_set1_epi8(0x7f);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned m = static_cast<unsigned>(
+            _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpgt_epi8(space, v), _mm256_cmpeq_epi8(v, del))));
+        if (m)
+            return p + __builtin_ctz(m);
+    }
+    return find_special_sse2(p, end);
+}
+
+SCAN_AVX2 inline size_t count_words_avx2(const char* p, size_t n, bool prev_space)
+{
+    if (n == 0)
+        return 0;
+    size_t total = count_words_scalar(p, 0, 1, prev_space), i = 1;
+    while (n - i >= 32)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        size_t blocks = (n - i) / 32 < 255 ? (n - i) / 32 : 255;
+        for (size_t b = 0; b < blocks; ++b, i += 32)
+        {
+            __m256i cur = space_mask_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+            __m256i prev = space_mask_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i - 1)));
+            acc = _mm256_sub_epi8(acc, _mm256_andnot_si256(cur, prev));
+        }
+        total += sum_bytes_avx2(acc);
+    }
+    return total + count_words_scalar(p, i, n, is_space(static_cast<unsigned char>(p[i - 1])));
+}
+
+SCAN_AVX2 inline const char* find_substr_avx2(const char* p, const char* end, std::string_view needle, bool icase)
+{
+    size_t k = needle.size();
+    char f = needle[0], l = needle[k - 1];
+    const __m256i f1 = _mm256_set1_epi8(icase ? fold(f) : f), f2 = _mm256_set1_epi8(icase ? unfold(f) : f);
+    const __m256i l1 = _mm256_set1_epi8(icase ? fold(l) : l), l2 = _mm256_set1_epi8(icase ? unfold(l) : l);
+    for (; static_cast<size_t>(end - p) >= k - 1 + 32; p += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k - 1));
+        __m256i hit = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, f1), _mm256_cmpeq_epi8(a, f2)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(b, l1), _mm256_cmpeq_epi8(b, l2)));
+        for (unsigned m = static_cast<unsigned>(_mm256_movemask_epi8(hit)); m; m &= m - 1)
+        {
+            const char* at = p + __builtin_ctz(m);
+            if (equal(at, needle.data(), k, icase))
+                return at;
+        }
+    }
+    return find_substr_sse2(p, end, needle, icase);
+}
+
+#undef SCAN_AVX2
+
+#endif // SCAN_X86
+
+} // namespace detail
+
+#ifdef SCAN_X86
+#define SCAN_DISPATCH(fn, ...)                                                                                         \
+    switch (level())                                                                                                   \
+    {                                                                                                                  \
+    case Level::AVX2:                                                                                                  \
+        return detail::fn##_avx2(__VA_ARGS__);                                                                         \
+    case Level::SSE2:                                                                                                  \
+        return detail::fn##_sse2(__VA_ARGS__);                                                                         \
+    default:                                                                                                           \
+        return detail::fn##_scalar(__VA_ARGS__);                                                                       \
+    }
+#else
+#define SCAN_DISPATCH(fn, ...) return detail::fn##_scalar(__VA_ARGS__);
+#endif
+
+// Occurrences of c in p[0, n).
+inline size_t count_byte(const char* p, size_t n, char c)
+{
+    SCAN_DISPATCH(count_byte, p, n, c)
+}
+
+// First c in [p, end), or end (memchr).
+inline const char* find_byte(const char* p, const char* end, char c)
+{
+    SCAN_DISPATCH(find_byte, p, end, c)
+}
+
+// First byte in [p, end) that is a control character, DEL or non-ASCII.
+inline const char* find_special(const char* p, const char* end)
+{
+    SCAN_DISPATCH(find_special, p, end)
+}
+
+// Words (runs of non-space bytes) starting in p[0, n). in_word carries
+// across calls: pass false before the first buffer.
+inline size_t count_words(const char* p, size_t n, bool& in_word)
+{
+    bool prev_space = !in_word;
+    if (n > 0)
+        in_word = !is_space(static_cast<unsigned char>(p[n - 1]));
+#ifdef SCAN_X86
+    switch (level())
+    {
+    case Level::AVX2:
+        return detail::count_words_avx2(p, n, prev_space);
+    case Level::SSE2:
+        return detail::count_words_sse2(p, n, prev_space);
+    default:
+        break;
+    }
+#endif
+    return detail::count_words_scalar(p, 0, n, prev_space);
+}
+
+// First occurrence of needle in [p, end), or end. icase folds ASCII only.
+inline const char* find_substr(const char* p, const char* end, std::string_view needle, bool icase = false)
+{
+    if (needle.empty())
+        return p;
+    if (static_cast<size_t>(end - p) < needle.size())
+        return end;
+    SCAN_DISPATCH(find_substr, p, end, needle, icase)
+}
+
+#undef SCAN_DISPATCH
+
+// Start of the line containing p: just after the previous '\n' at or after
+// begin.
+inline const char* line_start(const char* begin, const char* p)
+{
+    while (p > begin && p[-1] != '\n')
+        p--;
+    return p;
+}
+
+constexpr size_t CHUNK_SIZE = 1 << 20;
+
+// Reads a descriptor in large chunks that end on a line boundary, carrying
+// the partial last line into the next chunk (growing the buffer for lines
+// longer than it). The final chunk may lack a trailing newline.
+struct LineChunks
+{
+    std::vector<char> buf{};
+    size_t len{0};   // bytes in buf
+    size_t start{0}; // first byte not yet handed out
+    bool eof{false};
+    bool failed{false};
+
+    // False at end of input, or on a read error with failed set.
+    bool next(int fd, const char*& begin, const char*& end)
+    {
+        if (eof)
+            return false;
+        if (buf.empty())
+            buf.resize(CHUNK_SIZE);
+        std::memmove(buf.data(), buf.data() + start, len - start);
+        len -= start;
+        start = 0;
+        while (true)
+        {
+            if (len == buf.size())
+                buf.resize(buf.size() * 2);
+            ssize_t n = ::read(fd, buf.data() + len, buf.size() - len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                failed = true;
+                return false;
+            }
+            begin = buf.data();
+            if (n == 0)
+            {
+                eof = true;
+                end = begin + len;
+                start = len;
+                return len > 0;
+            }
+            size_t old = len;
+            len += static_cast<size_t>(n);
+            // The carried part has no newline, so only new bytes can end a line.
+            const char* cut = line_start(begin + old, begin + len);
+            if (cut > begin + old)
+            {
+                end = cut;
+                start = static_cast<size_t>(cut - begin);
+                return true;
+            }
+        }
+    }
+};
+
+} // namespace scan
+
+#endif // SCAN_HPP
@@ -0,0 +1,568 @@
+#ifndef SERVICE_HPP
+#define SERVICE_HPP
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "acct.hpp"
+#include "events.hpp"
+#include "util.hpp"
+
+constexpr const char* DEFAULT_UNIT_DIR = "/etc/init.d";
+constexpr const char* UNIT_DIR_ENV = "INIT_UNIT_DIR";
+constexpr int64_t RESTART_DELAY_NS = 100000000;       // first restart; doubles per quick exit
+constexpr int64_t RESTART_DELAY_MAX_NS = 5000000000;  // backoff ceiling
+constexpr int64_t RESTART_RESET_NS = 10000000000;     // a run this long clears the backoff
+constexpr uint32_t RESTART_LIMIT = 10;                // quick exits in a row before giving up
+constexpr size_t UNIT_FILE_MAX = 16 * 1024;
+constexpr const char* BOOT_TIMEOUT_ENV = "INIT_BOOT_TIMEOUT";
+constexpr int64_t BOOT_TIMEOUT_NS = 30000000000; // then the prompt comes up regardless
+
+// Unit files are key=value lines; '#' starts a comment.
+//
+//   type=mount|oneshot|daemon
+//   after=<unit> ...          ordering: start once these have settled
+//   exec=<path> <arg> ...     oneshot/daemon, split on blanks (no quoting)
+//   restart=no|on-failure|always   daemons only, default on-failure
+//   source= target= fstype= options=   mount; options mixes flags (ro,
+//                                      nosuid, ...) and fs data (mode=...)
+//
+// A mount is settled once mounted, a oneshot when it exits and a daemon as
+// soon as it has been started. Failures are reported but do not stop the
+// units ordered after them.
+enum class UnitType : uint8_t
+{
+    Oneshot,
+    Daemon,
+    Mount,
+};
+
+enum class Restart : uint8_t
+{
+    No,
+    OnFailure,
+    Always,
+};
+
+enum class UnitState : uint8_t
+{
+    Waiting,
+    Running,
+    Done,
+    Failed,
+};
+
+struct Unit
+{
+    std::string name{};
+    UnitType type{UnitType::Oneshot};
+    Restart restart{Restart::OnFailure};
+    std::vector<std::string> exec{};
+    std::vector<std::string> after{};
+    std::string source{};
+    std::string target{};
+    std::string fstype{};
+    std::string options{};
+
+    std::vector<uint32_t> dependents{};
+    uint32_t blocked{0}; // unsettled units in after=
+    bool settled{false};
+    UnitState state{UnitState::Waiting};
+    pid_t pid{0};
+    FD pidfd{};
+    int64_t started_ns{0};
+    int64_t settled_ns{0};
+    int64_t restart_at_ns{0};
+    uint32_t restarts{0};
+    int32_t status{0};
+};
+
+struct MountFlag
+{
+    std::string_view name;
+    unsigned long flag;
+};
+
+constexpr MountFlag MOUNT_FLAGS[] = {
+    {"ro", MS_RDONLY},         {"nosuid", MS_NOSUID},         {"nodev", MS_NODEV},
+    {"noexec", MS_NOEXEC},     {"noatime", MS_NOATIME},       {"nodiratime", MS_NODIRATIME},
+    {"relatime", MS_RELATIME}, {"sync", MS_SYNCHRONOUS},
+};
+
+// Starts units as a dependency graph with everything that is ready running
+// at once, then supervises daemons. Children are reaped by the caller's
+// reaper, which hands exits back through exited(); the restart timer is a
+// timerfd registered as Source::Service.
+struct ServiceManager
+{
+    std::vector<Unit> units{};
+    EventLoop* loop{nullptr};
+    FD timer{};
+    size_t settled{0};
+    int64_t boot_start_ns{0};
+    int64_t boot_end_ns{0};
+
+    bool booting() const
+    {
+        return settled < units.size();
+    }
+
+    // Reads every unit file in dir. Returns false if dir cannot be opened.
+    bool load(const char* dir)
+    {
+        FD dirfd(open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (!dirfd)
+            return false;
+        std::vector<std::string> names{};
+        for_each_dirent(dirfd.get(), [&](std::string_view name, unsigned char) {
+            if (name[0] != '.')
+                names.emplace_back(name);
+        });
+        std::sort(names.begin(), names.end());
+        for (const std::string& name : names)
+            load_unit(dirfd.get(), name);
+        return true;
+    }
+
+    void start(EventLoop& l)
+    {
+        loop = &l;
+        boot_start_ns = monotonic_ns();
+        timer = FD(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+        if (timer)
+            loop->add(timer.get(), Source::Service, 0);
+
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            for (const std::string& dep : units[i].after)
+            {
+                uint32_t d = find(dep);
+                if (d == UINT32_MAX)
+                {
+                    report(units[i], "unknown unit in after=: " + dep);
+                    continue;
+                }
+                units[d].dependents.push_back(i);
+                units[i].blocked++;
+            }
+        }
+        break_cycles();
+
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            if (units[i].blocked == 0 && !units[i].settled)
+                launch(i);
+        }
+        if (units.empty())
+            boot_end_ns = monotonic_ns();
+    }
+
+    // Called by the reaper for every exit. Returns false if pid is not a
+    // unit's process.
+    bool exited(pid_t pid, const siginfo_t& info)
+    {
+        auto it = std::find_if(units.begin(), units.end(), [&](const Unit& u) { return u.pid == pid; });
+        if (it == units.end())
+            return false;
+        Unit& u = *it;
+        uint32_t i = static_cast<uint32_t>(it - units.begin());
+        if (u.pidfd)
+            loop->remove(u.pidfd.get());
+        u.pidfd = FD();
+        u.pid = 0;
+        bool killed = info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED;
+        u.status = killed ? 128 + info.si_status : info.si_status;
+        bool ok = !killed && info.si_status == 0;
+
+        if (u.type == UnitType::Daemon && (u.restart == Restart::Always || (u.restart == Restart::OnFailure && !ok)))
+        {
+            int64_t now = monotonic_ns();
+            if (now - u.started_ns >= RESTART_RESET_NS)
+                u.restarts = 0;
+            if (u.restarts >= RESTART_LIMIT)
+            {
+                u.state = UnitState::Failed;
+                report(u, "restarting too quickly, giving up");
+                return true;
+            }
+            int64_t delay = std::min(RESTART_DELAY_NS << std::min<uint32_t>(u.restarts, 6), RESTART_DELAY_MAX_NS);
+            u.restarts++;
+            u.state = UnitState::Waiting;
+            u.restart_at_ns = now + delay;
+            arm();
+            return true;
+        }
+
+        u.state = ok ? UnitState::Done : UnitState::Failed;
+        if (!ok && (killed || u.type != UnitType::Mount)) // a mount child reports its own error
+            report(u, killed ? std::string("killed by ") + strsignal(info.si_status)
+                             : "exit status " + std::to_string(info.si_status));
+        settle(i);
+        return true;
+    }
+
+    // Restart timer fired: relaunch every daemon that is due.
+    void on_timer()
+    {
+        clear_timer(timer.get());
+        int64_t now = monotonic_ns();
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            Unit& u = units[i];
+            if (u.state == UnitState::Waiting && u.restart_at_ns != 0 && u.restart_at_ns <= now)
+            {
+                u.restart_at_ns = 0;
+                launch(i);
+            }
+        }
+        arm();
+    }
+
+    // Blank-separated names of the units that have not settled yet.
+    std::string unsettled() const
+    {
+        std::string out{};
+        for (const Unit& u : units)
+        {
+            if (u.settled)
+                continue;
+            if (!out.empty())
+                out += ' ';
+            out += u.name;
+        }
+        return out;
+    }
+
+    // For a forked child that must not touch the parent's units.
+    void detach()
+    {
+        units.clear();
+        settled = 0;
+    }
+
+    void describe(std::string& out) const
+    {
+        static constexpr const char* TYPES[] = {"oneshot", "daemon", "mount"};
+        static constexpr const char* STATES[] = {"waiting", "running", "done", "failed"};
+        for (const Unit& u : units)
+        {
+            char buf[160];
+            int n = std::snprintf(buf, sizeof buf, "%-20s %-8s %-8s %7d %8u %9.1f ms\r\n", u.name.c_str(),
+                                  TYPES[static_cast<int>(u.type)], STATES[static_cast<int>(u.state)],
+                                  static_cast<int>(u.pid), u.restarts,
+                                  u.settled ? static_cast<double>(u.settled_ns - boot_start_ns) / 1e6 : 0.0);
+            out.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+  private:
+    uint32_t find(std::string_view name) const
+    {
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            if (units[i].name == name)
+                return i;
+        }
+        return UINT32_MAX;
+    }
+
+    static void report(const Unit& u, const std::string& what)
+    {
+        print_error("ERROR: init: ");
+        print_error(u.name);
+        print_error(": ");
+        print_error(what);
+        print_error("\r\n");
+    }
+
+    static std::vector<std::string> split(std::string_view s)
+    {
+        std::vector<std::string> out{};
+        size_t i = 0;
+        while (i < s.size())
+        {
+            while (i < s.size() && (s[i] == ' ' || s[i] == '\t'))
+                i++;
+            size_t start = i;
+            while (i < s.size() && s[i] != ' ' && s[i] != '\t')
+                i++;
+            if (i > start)
+                out.emplace_back(s.substr(start, i - start));
+        }
+        return out;
+    }
+
+    void load_unit(int dirfd, const std::string& name)
+    {
+        FD fd(openat(dirfd, name.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd)
+            return;
+        std::string text(UNIT_FILE_MAX, '\0');
+        size_t len = 0;
+        ssize_t r;
+        while (len < text.size() && (r = read(fd.get(), text.data() + len, text.size() - len)) > 0)
+            len += static_cast<size_t>(r);
+        text.resize(len);
+
+        Unit u{};
+        u.name = name;
+        bool valid = true;
+        std::string_view rest = text;
+        while (!rest.empty())
+        {
+            size_t nl = rest.find('\n');
+            std::string_view line = rest.substr(0, nl);
+            rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+            while (!line.empty() && (line.front() == ' ' || line.front() == '\t'))
+                line.remove_prefix(1);
+            while (!line.empty() && (line.back() == ' ' || line.back() == '\t' || line.back() == '\r'))
+                line.remove_suffix(1);
+            if (line.empty() || line[0] == '#')
+                continue;
+            size_t eq = line.find('=');
+            std::string_view key = line.substr(0, eq);
+            std::string_view value = eq == std::string_view::npos ? std::string_view() : line.substr(eq + 1);
+
+            if (key == "type" && value == "mount")
+                u.type = UnitType::Mount;
+            else if (key == "type" && value == "oneshot")
+                u.type = UnitType::Oneshot;
+            else if (key == "type" && value == "daemon")
+                u.type = UnitType::Daemon;
+            else if (key == "restart" && value == "no")
+                u.restart = Restart::No;
+            else if (key == "restart" && value == "on-failure")
+                u.restart = Restart::OnFailure;
+            else if (key == "restart" && value == "always")
+                u.restart = Restart::Always;
+            else if (key == "exec")
+                u.exec = split(value);
+            else if (key == "after")
+                u.after = split(value);
+            else if (key == "source")
+                u.source = value;
+            else if (key == "target")
+                u.target = value;
+            else if (key == "fstype")
+                u.fstype = value;
+            else if (key == "options")
+                u.options = value;
+            else
+            {
+                report(u, "bad line: " + std::string(line));
+                valid = false;
+            }
+        }
+        if (u.type == UnitType::Mount ? (u.target.empty() || u.fstype.empty()) : u.exec.empty())
+        {
+            report(u, u.type == UnitType::Mount ? "mount needs target= and fstype=" : "missing exec=");
+            valid = false;
+        }
+        if (!valid)
+        {
+            u.state = UnitState::Failed;
+            u.after.clear();
+        }
+        units.push_back(std::move(u));
+    }
+
+    // Kahn's algorithm over a copy of the counts; whatever is never freed
+    // sits on or behind a cycle and fails instead of waiting forever.
+    void break_cycles()
+    {
+        std::vector<uint32_t> blocked(units.size());
+        std::vector<uint32_t> ready{};
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            blocked[i] = units[i].blocked;
+            if (blocked[i] == 0)
+                ready.push_back(i);
+        }
+        size_t seen = 0;
+        while (!ready.empty())
+        {
+            uint32_t i = ready.back();
+            ready.pop_back();
+            seen++;
+            for (uint32_t d : units[i].dependents)
+            {
+                if (--blocked[d] == 0)
+                    ready.push_back(d);
+            }
+        }
+        if (seen == units.size())
+            return;
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            if (blocked[i] != 0)
+            {
+                report(units[i], "dependency cycle");
+                units[i].state = UnitState::Failed;
+            }
+        }
+        for (uint32_t i = 0; i < units.size(); ++i)
+        {
+            if (blocked[i] != 0)
+                settle(i);
+        }
+    }
+
+    void launch(uint32_t i)
+    {
+        Unit& u = units[i];
+        u.started_ns = monotonic_ns();
+        if (u.state == UnitState::Failed)
+        {
+            settle(i);
+            return;
+        }
+        u.pid = spawn(u);
+        if (u.pid < 0)
+        {
+            u.pid = 0;
+            u.state = UnitState::Failed;
+            report(u, std::string("fork: ") + strerror(errno));
+            settle(i);
+            return;
+        }
+        u.state = UnitState::Running;
+        u.pidfd = open_pidfd(u.pid);
+        if (u.pidfd)
+            loop->add(u.pidfd.get(), Source::Child, 0);
+        if (u.type == UnitType::Daemon)
+            settle(i);
+    }
+
+    void settle(uint32_t i)
+    {
+        Unit& u = units[i];
+        if (u.settled)
+            return;
+        u.settled = true;
+        u.settled_ns = monotonic_ns();
+        if (++settled == units.size())
+            boot_end_ns = u.settled_ns;
+        for (uint32_t d : u.dependents)
+        {
+            if (units[d].blocked > 0 && --units[d].blocked == 0 && !units[d].settled)
+                launch(d);
+        }
+    }
+
+    void arm()
+    {
+        int64_t next = 0;
+        for (const Unit& u : units)
+        {
+            if (u.restart_at_ns != 0 && (next == 0 || u.restart_at_ns < next))
+                next = u.restart_at_ns;
+        }
+        if (next != 0 && timer)
+            arm_timer(timer.get(), std::max<int64_t>(1, next - monotonic_ns()));
+    }
+
+    static bool mount_unit(const Unit& u, std::string& why)
+    {
+        unsigned long flags = 0;
+        std::string data{};
+        for (const std::string& opt : split_options(u.options))
+        {
+            auto f = std::find_if(std::begin(MOUNT_FLAGS), std::end(MOUNT_FLAGS),
+                                  [&](const MountFlag& m) { return m.name == opt; });
+            if (f != std::end(MOUNT_FLAGS))
+            {
+                flags |= f->flag;
+                continue;
+            }
+            if (!data.empty())
+                data += ',';
+            data += opt;
+        }
+        mkdir(u.target.c_str(), 0755);
+        const char* source = u.source.empty() ? u.fstype.c_str() : u.source.c_str();
+        if (mount(source, u.target.c_str(), u.fstype.c_str(), flags, data.empty() ? nullptr : data.c_str()) == 0 ||
+            errno == EBUSY)
+            return true;
+        why = "mount " + u.target + ": " + strerror(errno);
+        return false;
+    }
+
+    static std::vector<std::string> split_options(std::string_view s)
+    {
+        std::vector<std::string> out{};
+        while (!s.empty())
+        {
+            size_t comma = s.find(',');
+            if (comma != 0)
+                out.emplace_back(s.substr(0, comma));
+            if (comma == std::string_view::npos)
+                break;
+            s.remove_prefix(comma + 1);
+        }
+        return out;
+    }
+
+    // Units run in their own session with stdin on /dev/null, so the console
+    // prompt's Ctrl-C never reaches them. A mount also gets a child, so one
+    // that hangs on a slow device only holds up its dependents and the boot
+    // deadline can still pass.
+    pid_t spawn(const Unit& u)
+    {
+        std::vector<char*> argv{};
+        for (const std::string& a : u.exec)
+            argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            if (pid < -1) // raw fork from sys.S returns -errno
+                errno = -pid;
+            return -1;
+        }
+        if (pid != 0)
+            return pid;
+
+        sigprocmask(SIG_SETMASK, &loop->old_mask, nullptr);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        setsid();
+        int null = open("/dev/null", O_RDONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDIN_FILENO);
+            close(null);
+        }
+        if (u.type == UnitType::Mount)
+        {
+            std::string why{};
+            if (mount_unit(u, why))
+                _exit(0);
+            report(u, why);
+            _exit(1);
+        }
+        execvp(argv[0], argv.data());
+        print_error("ERROR: init: ");
+        print_error(u.name);
+        print_error(": exec '");
+        print_error(argv[0]);
+        print_error("': ");
+        print_error(strerror(errno));
+        print_error("\r\n");
+        _exit(127);
+    }
+};
+
+#endif // SERVICE_HPP
@@ -0,0 +1,277 @@
+#ifndef SYSCALL_HPP
+#define SYSCALL_HPP
+
+// Typed x86-64 Linux system calls as inline asm. Nothing here touches libc
+// or errno, so the same header serves the freestanding runtime (crt.cpp),
+// cat's io_uring prefetch (uring.hpp), the event loop's signalfd, timerfd
+// and pidfd reads (events.hpp) and bench/keys.cpp, which uses the call
+// table. The shell itself still goes through sys.S and libc for everything
+// else, errno included. Calls return a Result carrying either the value or
+// the kernel's error number.
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+struct stat;
+struct timespec;
+struct rusage;
+struct siginfo;
+struct io_uring_params;
+
+namespace sys
+{
+
+// name, number, argument count
+#define SYS_CALLS(X)                                                                                                   \
+    X(read, 0, 3)                                                                                                      \
+    X(write, 1, 3)                                                                                                     \
+    X(open, 2, 3)                                                                                                      \
+    X(close, 3, 1)                                                                                                     \
+    X(fstat, 5, 2)                                                                                                     \
+    X(poll, 7, 3)                                                                                                      \
+    X(lseek, 8, 3)                                                                                                     \
+    X(mmap, 9, 6)                                                                                                      \
+    X(munmap, 11, 2)                                                                                                   \
+    X(brk, 12, 1)                                                                                                      \
+    X(rt_sigaction, 13, 4)                                                                                             \
+    X(rt_sigprocmask, 14, 4)                                                                                           \
+    X(ioctl, 16, 3)                                                                                                    \
+    X(pread64, 17, 4)                                                                                                  \
+    X(pwrite64, 18, 4)                                                                                                 \
+    X(readv, 19, 3)                                                                                                    \
+    X(writev, 20, 3)                                                                                                   \
+    X(select, 23, 5)                                                                                                   \
+    X(madvise, 28, 3)                                                                                                  \
+    X(dup2, 33, 2)                                                                                                     \
+    X(nanosleep, 35, 2)                                                                                                \
+    X(getpid, 39, 0)                                                                                                   \
+    X(fork, 57, 0)                                                                                                     \
+    X(execve, 59, 3)                                                                                                   \
+    X(exit, 60, 1)                                                                                                     \
+    X(wait4, 61, 4)                                                                                                    \
+    X(kill, 62, 2)                                                                                                     \
+    X(fcntl, 72, 3)                                                                                                    \
+    X(fsync, 74, 1)                                                                                                    \
+    X(ftruncate, 77, 2)                                                                                                \
+    X(getcwd, 79, 2)                                                                                                   \
+    X(chdir, 80, 1)                                                                                                    \
+    X(fchmod, 91, 2)                                                                                                   \
+    X(fchown, 93, 3)                                                                                                   \
+    X(getrusage, 98, 2)                                                                                                \
+    X(getdents64, 217, 3)                                                                                              \
+    X(clock_gettime, 228, 2)                                                                                           \
+    X(exit_group, 231, 1)                                                                                              \
+    X(epoll_wait, 232, 4)                                                                                              \
+    X(epoll_ctl, 233, 4)                                                                                               \
+    X(waitid, 247, 5)                                                                                                  \
+    X(openat, 257, 4)                                                                                                  \
+    X(mkdirat, 258, 3)                                                                                                 \
+    X(newfstatat, 262, 4)                                                                                              \
+    X(unlinkat, 263, 3)                                                                                                \
+    X(readlinkat, 267, 4)                                                                                              \
+    X(pselect6, 270, 6)                                                                                                \
+    X(ppoll, 271, 5)                                                                                                   \
+    X(utimensat, 280, 4)                                                                                               \
+    X(epoll_pwait, 281, 6)                                                                                             \
+    X(pipe2, 293, 2)                                                                                                   \
+    X(renameat2, 316, 5)                                                                                               \
+    X(copy_file_range, 326, 6)                                                                                         \
+    X(io_uring_setup, 425, 2)                                                                                          \
+    X(io_uring_enter, 426, 6)                                                                                          \
+    X(pidfd_open, 434, 2)                                                                                              \
+    X(epoll_pwait2, 441, 6)
+
+enum class Nr : uint16_t
+{
+#define SYS_ENUM(name, nr, argc) name,
+    SYS_CALLS(SYS_ENUM)
+#undef SYS_ENUM
+};
+
+struct Info
+{
+    long nr;
+    const char* name;
+    int args;
+};
+
+constexpr Info TABLE[] = {
+#define SYS_INFO(name, nr, argc) {nr, #name, argc},
+    SYS_CALLS(SYS_INFO)
+#undef SYS_INFO
+};
+
+constexpr size_t COUNT = sizeof TABLE / sizeof TABLE[0];
+
+constexpr const Info& info(Nr n)
+{
+    return TABLE[static_cast<size_t>(n)];
+}
+
+// Name of a raw syscall number, or nullptr if it is not in the table.
+constexpr const char* name_of(long nr)
+{
+    for (const Info& i : TABLE)
+    {
+        if (i.nr == nr)
+            return i.name;
+    }
+    return nullptr;
+}
+
+inline long raw(long n, long a = 0, long b = 0, long c = 0, long d = 0, long e = 0, long f = 0)
+{
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    long ret;
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+                     : "rcx", "r11", "memory");
+    return ret;
+}
+
+template <typename T> inline long arg(T v)
+{
+    if constexpr (std::is_null_pointer_v<T>)
+        return 0;
+    else if constexpr (std::is_pointer_v<T>)
+        return reinterpret_cast<long>(v);
+    else
+        return static_cast<long>(v);
+}
+
+// The argument count is checked against the table at compile time.
+template <Nr N, typename... A> inline long call(A... a)
+{
+    static_assert(sizeof...(A) == info(N).args, "wrong number of syscall arguments");
+    return raw(info(N).nr, arg(a)...);
+}
+
+template <typename T> struct Result
+{
+    long raw;
+
+    bool ok() const
+    {
+        return static_cast<unsigned long>(raw) <= static_cast<unsigned long>(-4096L);
+    }
+    explicit operator bool() const
+    {
+        return ok();
+    }
+    int error() const
+    {
+        return ok() ? 0 : static_cast<int>(-raw);
+    }
+    T value() const
+    {
+        if constexpr (std::is_pointer_v<T>)
+            return reinterpret_cast<T>(raw);
+        else
+            return static_cast<T>(raw);
+    }
+};
+
+constexpr int AT_CWD = -100;
+
+inline Result<long> read(int fd, void* buf, size_t n)
+{
+    return {call<Nr::read>(fd, buf, n)};
+}
+inline Result<long> write(int fd, const void* buf, size_t n)
+{
+    return {call<Nr::write>(fd, buf, n)};
+}
+inline Result<long> pread(int fd, void* buf, size_t n, long off)
+{
+    return {call<Nr::pread64>(fd, buf, n, off)};
+}
+inline Result<int> openat(int dirfd, const char* path, int flags, unsigned mode = 0)
+{
+    return {call<Nr::openat>(dirfd, path, flags, mode)};
+}
+inline Result<int> close(int fd)
+{
+    return {call<Nr::close>(fd)};
+}
+inline Result<int> fstat(int fd, struct stat* st)
+{
+    return {call<Nr::fstat>(fd, st)};
+}
+inline Result<int> fstatat(int dirfd, const char* path, struct stat* st, int flags)
+{
+    return {call<Nr::newfstatat>(dirfd, path, st, flags)};
+}
+inline Result<long> lseek(int fd, long off, int whence)
+{
+    return {call<Nr::lseek>(fd, off, whence)};
+}
+inline Result<void*> mmap(void* addr, size_t len, int prot, int flags, int fd, long off)
+{
+    return {call<Nr::mmap>(addr, len, prot, flags, fd, off)};
+}
+inline Result<int> munmap(void* addr, size_t len)
+{
+    return {call<Nr::munmap>(addr, len)};
+}
+inline Result<int> ioctl(int fd, unsigned long req, void* argp)
+{
+    return {call<Nr::ioctl>(fd, req, argp)};
+}
+inline Result<int> mkdirat(int dirfd, const char* path, unsigned mode)
+{
+    return {call<Nr::mkdirat>(dirfd, path, mode)};
+}
+inline Result<int> unlinkat(int dirfd, const char* path, int flags)
+{
+    return {call<Nr::unlinkat>(dirfd, path, flags)};
+}
+inline Result<int> renameat2(int olddir, const char* oldpath, int newdir, const char* newpath, unsigned flags)
+{
+    return {call<Nr::renameat2>(olddir, oldpath, newdir, newpath, flags)};
+}
+inline Result<long> getdents64(int fd, void* buf, size_t n)
+{
+    return {call<Nr::getdents64>(fd, buf, n)};
+}
+inline Result<long> copy_file_range(int in, long* in_off, int out, long* out_off, size_t len, unsigned flags)
+{
+    return {call<Nr::copy_file_range>(in, in_off, out, out_off, len, flags)};
+}
+inline Result<int> clock_gettime(int clock, struct timespec* ts)
+{
+    return {call<Nr::clock_gettime>(clock, ts)};
+}
+inline Result<int> waitid(int idtype, int id, struct siginfo* info, int options, struct rusage* ru)
+{
+    return {call<Nr::waitid>(idtype, id, info, options, ru)};
+}
+inline Result<int> pidfd_open(int pid, unsigned flags)
+{
+    return {call<Nr::pidfd_open>(pid, flags)};
+}
+inline Result<int> io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return {call<Nr::io_uring_setup>(entries, p)};
+}
+inline Result<int> io_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return {call<Nr::io_uring_enter>(fd, submit, wait, flags, nullptr, 0)};
+}
+inline Result<int> getpid()
+{
+    return {call<Nr::getpid>()};
+}
+
+[[noreturn]] inline void exit_group(int code)
+{
+    call<Nr::exit_group>(code);
+    __builtin_unreachable();
+}
+
+} // namespace sys
+
+#endif // SYSCALL_HPP
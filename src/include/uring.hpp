@@ -0,0 +1,168 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+// A bare io_uring over the raw calls in syscall.hpp: no liburing and no libc,
+// so the freestanding applets can use it too. One thread queues, submits and
+// reaps; callers keep their in-flight operations below the queue sizes.
+
+#include <cerrno>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+
+#include "syscall.hpp"
+
+class Ring
+{
+  public:
+    Ring() = default;
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    ~Ring()
+    {
+        if (sqes)
+            sys::munmap(sqes, sqes_size);
+        if (ring)
+            sys::munmap(ring, ring_size);
+        if (fd >= 0)
+            sys::close(fd);
+    }
+
+    // False when io_uring is missing, blocked (seccomp, sysctl) or older
+    // than 5.6, which brought OPENAT, READ and CLOSE along with RW_CUR_POS.
+    bool init(unsigned entries)
+    {
+        io_uring_params p{};
+        auto r = sys::io_uring_setup(entries, &p);
+        if (!r)
+            return false;
+        fd = r.value();
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_RW_CUR_POS))
+            return false;
+
+        size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        ring_size = sq_size > cq_size ? sq_size : cq_size;
+        auto m = sys::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_SQ_RING);
+        if (!m)
+            return false;
+        ring = static_cast<char*>(m.value());
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        auto s = sys::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_SQES);
+        if (!s)
+            return false;
+        sqes = static_cast<io_uring_sqe*>(s.value());
+
+        sq_head = field(p.sq_off.head);
+        sq_tail = field(p.sq_off.tail);
+        sq_mask = *field(p.sq_off.ring_mask);
+        sq_entries = p.sq_entries;
+        cq_head = field(p.cq_off.head);
+        cq_tail = field(p.cq_off.tail);
+        cq_mask = *field(p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(ring + p.cq_off.cqes);
+        // Entries are used in ring order, so the index array is fixed.
+        unsigned* array = field(p.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; ++i)
+            array[i] = i;
+        tail = *sq_tail;
+        return true;
+    }
+
+    // A zeroed entry, or nullptr while the submission queue is full.
+    io_uring_sqe* get()
+    {
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+            return nullptr;
+        io_uring_sqe* e = &sqes[tail++ & sq_mask];
+        *e = io_uring_sqe{};
+        return e;
+    }
+
+    // Entries queued with get() that the kernel has not consumed yet.
+    unsigned queued() const
+    {
+        return tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    // Hands the queued entries over and waits for at least `wait`
+    // completions. Returns the kernel's error number, or 0.
+    int submit(unsigned wait)
+    {
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        while (true)
+        {
+            auto r = sys::io_uring_enter(fd, queued(), wait, wait ? IORING_ENTER_GETEVENTS : 0);
+            if (r || r.error() != EINTR)
+                return r.error();
+        }
+    }
+
+    // The oldest unseen completion, or nullptr.
+    io_uring_cqe* peek() const
+    {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            return nullptr;
+        return &cqes[head & cq_mask];
+    }
+
+    // Releases the completion returned by peek().
+    void seen()
+    {
+        __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+    }
+
+  private:
+    int fd{-1};
+    char* ring{nullptr};
+    size_t ring_size{0};
+    io_uring_sqe* sqes{nullptr};
+    size_t sqes_size{0};
+    unsigned* sq_head{nullptr};
+    unsigned* sq_tail{nullptr};
+    unsigned sq_mask{0};
+    unsigned sq_entries{0};
+    unsigned tail{0}; // local tail, published by submit()
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    unsigned cq_mask{0};
+    io_uring_cqe* cqes{nullptr};
+
+    unsigned* field(uint32_t off) const
+    {
+        return reinterpret_cast<unsigned*>(ring + off);
+    }
+};
+
+inline void prep_openat(io_uring_sqe* e, const char* path, int flags, uint64_t data)
+{
+    e->opcode = IORING_OP_OPENAT;
+    e->fd = sys::AT_CWD;
+    e->addr = reinterpret_cast<uint64_t>(path);
+    e->open_flags = static_cast<uint32_t>(flags);
+    e->user_data = data;
+}
+
+// An offset of -1 reads at, and advances, the file position.
+inline void prep_read(io_uring_sqe* e, int fd, void* buf, unsigned len, uint64_t off, uint64_t data)
+{
+    e->opcode = IORING_OP_READ;
+    e->fd = fd;
+    e->addr = reinterpret_cast<uint64_t>(buf);
+    e->len = len;
+    e->off = off;
+    e->user_data = data;
+}
+
+inline void prep_close(io_uring_sqe* e, int fd, uint64_t data)
+{
+    e->opcode = IORING_OP_CLOSE;
+    e->fd = fd;
+    e->user_data = data;
+}
+
+#endif // URING_HPP
@@ -0,0 +1,540 @@
+#ifndef UTF8_HPP
+#define UTF8_HPP
+
+// UTF-8 for the line editors: decoding, validation, terminal widths and
+// byte-to-column maps. Bytes that are not valid UTF-8 stay in the text, take
+// one column each and are drawn as U+FFFD, so any file can still be edited
+// byte for byte. The validator and the ASCII scan run at the level scan.hpp
+// picked for the CPU.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scan.hpp"
+#include "width_table.hpp"
+
+namespace utf8
+{
+
+constexpr uint32_t REPLACEMENT = 0xfffd;
+constexpr std::string_view REPLACEMENT_UTF8 = "\xef\xbf\xbd";
+
+inline bool is_continuation(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+
+// Length of the sequence a lead byte starts, or 0 if it cannot start one.
+inline size_t sequence_length(unsigned char c)
+{
+    if (c < 0x80)
+        return 1;
+    if (c < 0xc2)
+        return 0;
+    if (c < 0xe0)
+        return 2;
+    if (c < 0xf0)
+        return 3;
+    return c < 0xf5 ? 4 : 0;
+}
+
+// Decodes the character at p. Returns its length, or 0 with cp set to
+// REPLACEMENT for anything invalid: stray or missing continuation bytes,
+// overlong forms, surrogates and values above U+10FFFF.
+inline size_t decode(const char* p, const char* end, uint32_t& cp)
+{
+    auto b0 = static_cast<unsigned char>(*p);
+    size_t n = sequence_length(b0);
+    cp = REPLACEMENT;
+    if (n == 0 || static_cast<size_t>(end - p) < n)
+        return 0;
+    uint32_t v = n == 1 ? b0 : b0 & (0x7fu >> n);
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (!is_continuation(p[i]))
+            return 0;
+        v = v << 6 | (static_cast<unsigned char>(p[i]) & 0x3f);
+    }
+    if ((n == 3 && (v < 0x800 || (v >= 0xd800 && v <= 0xdfff))) || (n == 4 && (v < 0x10000 || v > 0x10ffff)))
+        return 0;
+    cp = v;
+    return n;
+}
+
+// Writes cp (a valid scalar value) to out; returns the length.
+inline size_t encode(uint32_t cp, char* out)
+{
+    if (cp < 0x80)
+    {
+        out[0] = static_cast<char>(cp);
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = static_cast<char>(0xc0 | cp >> 6);
+        out[1] = static_cast<char>(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = static_cast<char>(0xe0 | cp >> 12);
+        out[1] = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        out[2] = static_cast<char>(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xf0 | cp >> 18);
+    out[1] = static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+    out[2] = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Keys that insert text: everything but C0/C1 controls, DEL, surrogates
+// and the named keys above U+10FFFF.
+inline bool printable(int32_t cp)
+{
+    return (cp >= 0x20 && cp < 0x7f) || (cp >= 0xa0 && cp < 0x110000 && (cp < 0xd800 || cp > 0xdfff));
+}
+
+// Terminal columns of cp: 0, 1 or 2 (see tools/gen_width.py).
+inline unsigned width(uint32_t cp)
+{
+    if (cp < 0x300)
+        return 1;
+    if (cp >= WIDTH_TABLE_LIMIT)
+        return cp == 0xe0001 || (cp >= 0xe0020 && cp <= 0xe007f) || (cp >= 0xe0100 && cp <= 0xe01ef) ? 0 : 1;
+    unsigned block = WIDTH_BLOCKS[cp >> WIDTH_BLOCK_SHIFT];
+    unsigned i = cp & ((1u << WIDTH_BLOCK_SHIFT) - 1);
+    return WIDTH_BITS[(block << WIDTH_BLOCK_SHIFT | i) / 4] >> (i % 4 * 2) & 3;
+}
+
+namespace detail
+{
+
+inline size_t ascii_prefix_scalar(const char* p, size_t n)
+{
+    size_t i = 0;
+    for (; n - i >= 8; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        if (w & 0x8080808080808080ull)
+            break;
+    }
+    while (i < n && static_cast<unsigned char>(p[i]) < 0x80)
+        i++;
+    return i;
+}
+
+inline bool valid_scalar(const char* p, size_t n)
+{
+    const char* end = p + n;
+    while (p < end)
+    {
+        p += ascii_prefix_scalar(p, static_cast<size_t>(end - p));
+        uint32_t cp;
+        while (p < end && static_cast<unsigned char>(*p) >= 0x80)
+        {
+            size_t k = decode(p, end, cp);
+            if (k == 0)
+                return false;
+            p += k;
+        }
+    }
+    return true;
+}
+
+#ifdef SCAN_X86
+
+inline size_t ascii_prefix_sse2(const char* p, size_t n)
+{
+    size_t i = 0;
+    for (; n - i >= 16; i += 16)
+    {
+        int m = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+        if (m)
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(m)));
+    }
+    return i + ascii_prefix_scalar(p + i, n - i);
+}
+
+// SSE2 has no byte shuffle for the table lookups below, so only the ASCII
+// runs between multibyte characters are skipped with vectors.
+inline bool valid_sse2(const char* p, size_t n)
+{
+    const char* end = p + n;
+    while (p < end)
+    {
+        p += ascii_prefix_sse2(p, static_cast<size_t>(end - p));
+        uint32_t cp;
+        while (p < end && static_cast<unsigned char>(*p) >= 0x80)
+        {
+            size_t k = decode(p, end, cp);
+            if (k == 0)
+                return false;
+            p += k;
+        }
+    }
+    return true;
+}
+
+#define UTF8_AVX2 __attribute__((target("avx2")))
+
+UTF8_AVX2 inline size_t ascii_prefix_avx2(const char* p, size_t n)
+{
+    size_t i = 0;
+    for (; n - i >= 32; i += 32)
+    {
+        int m = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+        if (m)
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(m)));
+    }
+    return i + ascii_prefix_sse2(p + i, n - i);
+}
+
+// The bytes N positions back, reaching into the previous block.
+template <int N> UTF8_AVX2 inline __m256i prev_avx2(__m256i input, __m256i prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+UTF8_AVX2 inline __m256i lookup_avx2(__m256i nibbles, const uint8_t (&t)[16])
+{
+    __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t));
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(table), nibbles);
+}
+
+// Error flags for a byte given the one before it. Three 16-entry tables,
+// indexed by the previous byte's high and low nibble and this byte's high
+// nibble, are and-ed; any bit left over is an error, except that TWO_CONTS
+// is expected exactly where a 3- or 4-byte sequence needs its third or
+// fourth byte (Keiser and Lemire, "Validating UTF-8 in less than one
+// instruction per byte").
+constexpr uint8_t TOO_SHORT = 1 << 0;
+constexpr uint8_t TOO_LONG = 1 << 1;
+constexpr uint8_t OVERLONG_3 = 1 << 2;
+constexpr uint8_t TOO_LARGE = 1 << 3;
+constexpr uint8_t SURROGATE = 1 << 4;
+constexpr uint8_t OVERLONG_2 = 1 << 5;
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr uint8_t OVERLONG_4 = 1 << 6;
+constexpr uint8_t TWO_CONTS = 1 << 7;
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+constexpr uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, TOO_SHORT | OVERLONG_2, TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE, TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+constexpr uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+constexpr uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+    TOO_SHORT,
+};
+
+UTF8_AVX2 inline __m256i block_errors_avx2(__m256i input, __m256i prev)
+{
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    __m256i prev1 = prev_avx2<1>(input, prev);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(lookup_avx2(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), low4), BYTE_1_HIGH),
+                         lookup_avx2(_mm256_and_si256(prev1, low4), BYTE_1_LOW)),
+        lookup_avx2(_mm256_and_si256(_mm256_srli_epi16(input, 4), low4), BYTE_2_HIGH));
+    // Bytes two after an E0..FF lead or three after an F0..FF lead.
+    __m256i third = _mm256_subs_epu8(prev_avx2<2>(input, prev), _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev_avx2<3>(input, prev), _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23, special);
+}
+
+// Checks one 32-byte block, accumulating into error; prev and incomplete
+// carry the state between blocks.
+UTF8_AVX2 inline void check_block_avx2(__m256i input, __m256i& prev, __m256i& incomplete, __m256i& error)
+{
+    // Non-zero where a lead in the last three bytes still wants more.
+    const __m256i max_tail = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xf0 - 1),
+                                              static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+    if (_mm256_movemask_epi8(input) == 0)
+    {
+        error = _mm256_or_si256(error, incomplete);
+        incomplete = _mm256_setzero_si256();
+    }
+    else
+    {
+        error = _mm256_or_si256(error, block_errors_avx2(input, prev));
+        incomplete = _mm256_subs_epu8(input, max_tail);
+    }
+    prev = input;
+}
+
+UTF8_AVX2 inline bool valid_avx2(const char* p, size_t n)
+{
+    __m256i error = _mm256_setzero_si256(), prev = error, incomplete = error;
+    size_t i = 0;
+    for (; n - i >= 32; i += 32)
+    {
+        check_block_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), prev, incomplete, error);
+        if ((i & 4095) == 0 && !_mm256_testz_si256(error, error))
+            return false;
+    }
+    if (i < n)
+    {
+        // Zero padding is ASCII, which also flags a sequence cut off by the end.
+        char tail[32]{};
+        std::memcpy(tail, p + i, n - i);
+        check_block_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)), prev, incomplete, error);
+    }
+    error = _mm256_or_si256(error, incomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+#undef UTF8_AVX2
+
+#endif // SCAN_X86
+
+} // namespace detail
+
+#ifdef SCAN_X86
+#define UTF8_DISPATCH(fn, ...)                                                                                         \
+    switch (scan::level())                                                                                             \
+    {                                                                                                                  \
+    case scan::Level::AVX2:                                                                                            \
+        return detail::fn##_avx2(__VA_ARGS__);                                                                         \
+    case scan::Level::SSE2:                                                                                            \
+        return detail::fn##_sse2(__VA_ARGS__);                                                                         \
+    default:                                                                                                           \
+        return detail::fn##_scalar(__VA_ARGS__);                                                                       \
+    }
+#else
+#define UTF8_DISPATCH(fn, ...) return detail::fn##_scalar(__VA_ARGS__);
+#endif
+
+// Length of the leading run of ASCII bytes in p[0, n).
+inline size_t ascii_prefix(const char* p, size_t n)
+{
+    UTF8_DISPATCH(ascii_prefix, p, n)
+}
+
+// Whether p[0, n) is entirely valid UTF-8.
+inline bool valid(const char* p, size_t n)
+{
+    UTF8_DISPATCH(valid, p, n)
+}
+
+#undef UTF8_DISPATCH
+
+inline bool valid(std::string_view s)
+{
+    return valid(s.data(), s.size());
+}
+
+// Length of the character at s[i]; an invalid byte is one character.
+inline size_t char_length(std::string_view s, size_t i)
+{
+    uint32_t cp;
+    size_t n = decode(s.data() + i, s.data() + s.size(), cp);
+    return n ? n : 1;
+}
+
+inline unsigned char_width(std::string_view s, size_t i)
+{
+    uint32_t cp;
+    return decode(s.data() + i, s.data() + s.size(), cp) ? width(cp) : 1;
+}
+
+// Start of the character that ends at s[i].
+inline size_t prev_char(std::string_view s, size_t i)
+{
+    size_t k = i - 1, limit = i > 4 ? i - 4 : 0;
+    while (k > limit && is_continuation(s[k]))
+        k--;
+    return k + char_length(s, k) == i ? k : i - 1;
+}
+
+// Cursor steps: a character together with the zero-width marks after it.
+inline size_t next(std::string_view s, size_t i)
+{
+    if (i >= s.size())
+        return s.size();
+    i += char_length(s, i);
+    while (i < s.size() && static_cast<unsigned char>(s[i]) >= 0x80 && char_width(s, i) == 0)
+        i += char_length(s, i);
+    return i;
+}
+
+inline size_t prev(std::string_view s, size_t i)
+{
+    if (i == 0)
+        return 0;
+    i = prev_char(s, i);
+    while (i > 0 && static_cast<unsigned char>(s[i]) >= 0x80 && char_width(s, i) == 0)
+        i = prev_char(s, i);
+    return i;
+}
+
+// Appends s for display, with U+FFFD for each invalid byte.
+inline void append_display(std::string& out, std::string_view s)
+{
+    if (valid(s))
+    {
+        out.append(s);
+        return;
+    }
+    for (size_t i = 0; i < s.size();)
+    {
+        uint32_t cp;
+        size_t n = decode(s.data() + i, s.data() + s.size(), cp);
+        if (n)
+            out.append(s, i, n);
+        else
+            out.append(REPLACEMENT_UTF8);
+        i += n ? n : 1;
+    }
+}
+
+// The display column of every byte of one line, so cursor placement and
+// scrolling need no rescan. A pure ASCII line, the common case, has no
+// table: the column is the offset. With a wrap width, a wide character that
+// would straddle a row edge starts the next row, as on the terminal. With a
+// tab stop, '\t' reaches up to the next multiple of it. Zero-width
+// characters sit at the column after the one they modify.
+class ColumnMap
+{
+  public:
+    bool built{false};
+
+    // Maps text, reusing the entries for its first `keep` bytes, which must
+    // be unchanged since the previous build with the same wrap width and
+    // tab stop.
+    void build(std::string_view text, size_t wrap = 0, size_t keep = 0, size_t tab = 0)
+    {
+        built = true;
+        size = text.size();
+        if (keep == 0 || keep > size)
+            table.clear();
+        size_t i, col;
+        if (table.empty())
+        {
+            i = col = std::min(ascii_prefix(text.data(), size), tab ? text.find('\t') : size);
+            if (i == size)
+                return;
+            table.resize(size + 1);
+            for (size_t k = 0; k < i; ++k)
+                table[k] = static_cast<uint32_t>(k);
+        }
+        else
+        {
+            // Resume at a character start, from the column after the
+            // character before it.
+            i = keep;
+            while (i > 0 && is_continuation(text[i - 1]))
+                i--;
+            if (i > 0 && static_cast<unsigned char>(text[i - 1]) >= 0x80)
+                i--;
+            table.resize(size + 1);
+            col = 0;
+            if (i > 0)
+            {
+                size_t j = prev_char(text, i);
+                col = text[j] == '\t' && tab ? (table[j] / tab + 1) * tab : table[j] + char_width(text, j);
+            }
+        }
+        while (i < size)
+        {
+            if (text[i] == '\t' && tab)
+            {
+                table[i++] = static_cast<uint32_t>(col);
+                col = (col / tab + 1) * tab;
+                continue;
+            }
+            if (static_cast<unsigned char>(text[i]) < 0x80)
+            {
+                table[i++] = static_cast<uint32_t>(col++);
+                continue;
+            }
+            size_t n = char_length(text, i);
+            unsigned w = char_width(text, i);
+            if (w == 2 && wrap > 1 && col % wrap == wrap - 1)
+                col++;
+            for (size_t k = 0; k < n; ++k)
+                table[i + k] = static_cast<uint32_t>(col);
+            i += n;
+            col += w;
+        }
+        table[size] = static_cast<uint32_t>(col);
+    }
+
+    void reset()
+    {
+        built = false;
+    }
+
+    // Column of the character containing byte i (i <= the text's size).
+    size_t column(size_t i) const
+    {
+        return table.empty() ? i : table[i];
+    }
+
+    size_t columns() const
+    {
+        return column(size);
+    }
+
+    // Start of the character at or left of column c, or the end of the text.
+    size_t byte_at(std::string_view text, size_t c) const
+    {
+        if (table.empty())
+            return c < size ? c : size;
+        auto it = std::upper_bound(table.begin(), table.end(), c);
+        size_t i = static_cast<size_t>(std::lower_bound(table.begin(), it, *(it - 1)) - table.begin());
+        // Marks share the column of what follows them; skip to that.
+        while (i < size && static_cast<unsigned char>(text[i]) >= 0x80 && char_width(text, i) == 0)
+            i += char_length(text, i);
+        return i;
+    }
+
+  private:
+    std::vector<uint32_t> table{}; // empty while the text is ASCII
+    size_t size{0};
+};
+
+} // namespace utf8
+
+#endif // UTF8_HPP
@@ -2,6 +2,7 @@
 #define UTIL_HPP
 
 #include <cerrno>
+#include <cstdint>
 #include <dirent.h>
 #include <string.h>
 #include <string_view>
@@ -179,4 +180,34 @@ struct Dir
     }
 };
 
+constexpr size_t DENTS_BUFFER_SIZE = 32 * 1024;
+
+// Calls fn(name, d_type) for each entry of an open directory, reading it in
+// large getdents64 batches. "." and ".." are skipped. Returns false on error.
+template <typename F> inline bool for_each_dirent(int dirfd, F&& fn)
+{
+    alignas(8) char buf[DENTS_BUFFER_SIZE];
+    while (true)
+    {
+        ssize_t n = getdents64(dirfd, buf, sizeof buf);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (n == 0)
+            return true;
+        for (ssize_t off = 0; off < n;)
+        {
+            auto* d = reinterpret_cast<dirent64*>(buf + off);
+            off += d->d_reclen;
+            const char* name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            fn(std::string_view(name), d->d_type);
+        }
+    }
+}
+
 #endif // UTIL_HPP
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "include/copy.hpp"
+#include "include/util.hpp"
+
+// Renames src to dst. With no_clobber an existing dst is left alone
+// (RENAME_NOREPLACE, or a racy check on filesystems without it).
+static int rename_path(const std::string& src, const std::string& dst, bool no_clobber)
+{
+    if (renameat2(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), no_clobber ? RENAME_NOREPLACE : 0) == 0)
+        return 0;
+    if (!no_clobber || errno != EINVAL)
+        return -1;
+    struct stat st{};
+    if (lstat(dst.c_str(), &st) == 0)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    return renameat2(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), 0);
+}
+
+// rename(2) cannot cross filesystems: copy with ownership, modes and times,
+// then remove the source once the whole copy has succeeded.
+static bool move_across(std::string_view prog, const std::string& src, const std::string& dst)
+{
+    struct stat st{};
+    if (lstat(src.c_str(), &st) != 0)
+    {
+        print_errno(prog, "stat", src);
+        return false;
+    }
+    struct stat existing{};
+    if (S_ISDIR(st.st_mode) && lstat(dst.c_str(), &existing) == 0 && S_ISDIR(existing.st_mode) &&
+        rmdir(dst.c_str()) != 0)
+    {
+        print_errno(prog, "replace", dst);
+        return false;
+    }
+    CopyPool pool(prog, S_ISDIR(st.st_mode) ? CopyPool::default_threads() : 1, true);
+    bool copied = pool.copy(src, dst, st);
+    if (!pool.finish() || !copied)
+        return false;
+    return remove_tree(prog, src);
+}
+
+int32_t main(int32_t argc, char* argv[])
+{
+    auto args = make_args(argc, argv);
+    auto prog = prog_name(args[0]);
+
+    bool no_clobber = false;
+    std::vector<std::string_view> operands;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-n" && operands.empty())
+            no_clobber = true;
+        else
+            operands.push_back(args[i]);
+    }
+    if (!require_args(prog, operands.size(), 2, "usage: mv [-n] source... dest"))
+        return 1;
+
+    std::string dest(operands.back());
+    operands.pop_back();
+    struct stat dest_st{};
+    bool into_dir = stat(dest.c_str(), &dest_st) == 0 && S_ISDIR(dest_st.st_mode);
+    if (operands.size() > 1 && !into_dir)
+    {
+        print_error("ERROR: ");
+        print_error(prog);
+        print_error(": '");
+        print_error(dest);
+        print_error("' is not a directory\r\n");
+        return 1;
+    }
+
+    int32_t ret = 0;
+    for (std::string_view operand : operands)
+    {
+        std::string src(operand);
+        std::string dst = into_dir ? join_path(dest, base_name(src)) : dest;
+        if (rename_path(src, dst, no_clobber) == 0)
+            continue;
+        if (errno == EEXIST && no_clobber)
+            continue;
+        if (errno != EXDEV)
+        {
+            print_errno(prog, "rename", src);
+            ret = 1;
+            continue;
+        }
+        struct stat st{};
+        if (no_clobber && lstat(dst.c_str(), &st) == 0)
+            continue;
+        if (!move_across(prog, src, dst))
+            ret = 1;
+    }
+    return ret;
+}
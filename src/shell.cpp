@@ -1,33 +1,128 @@
+#include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string>
 #include <string_view>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 #include <vector>
 
+#include "include/acct.hpp"
+#include "include/arena.hpp"
+#include "include/complete.hpp"
+#include "include/events.hpp"
+#include "include/history.hpp"
+#include "include/input.hpp"
+#include "include/lineedit.hpp"
+#include "include/parser.hpp"
+#include "include/service.hpp"
+#include "include/utf8.hpp"
 #include "include/util.hpp"
 
+constexpr char ctrl_key(char c)
+{
+    return c & 0x1f;
+}
 constexpr const char BACKSPACE = '\x7f';
-constexpr const char CTR_C = '\x03';
-constexpr const char CTR_D = '\x04';
-constexpr const char ESC_SEQ = '\x1b';
+constexpr const char CTR_A = ctrl_key('A');
+constexpr const char CTR_B = ctrl_key('B');
+constexpr const char CTR_C = ctrl_key('C');
+constexpr const char CTR_D = ctrl_key('D');
+constexpr const char CTR_E = ctrl_key('E');
+constexpr const char CTR_F = ctrl_key('F');
+constexpr const char CTR_H = ctrl_key('H');
+constexpr const char CTR_K = ctrl_key('K');
+constexpr const char CTR_G = ctrl_key('G');
+constexpr const char CTR_L = ctrl_key('L');
+constexpr const char CTR_R = ctrl_key('R');
+constexpr const char CTR_U = ctrl_key('U');
+constexpr const char CTR_W = ctrl_key('W');
+constexpr const char CTR_Y = ctrl_key('Y');
 
 constexpr const size_t PREALLOC_COMMAND_SIZE = 255;
-constexpr const size_t MAX_HISTORY = 100;
 constexpr const char* PROMPT_PRELUDE = "#> ";
 
+constexpr std::string_view BUILTINS[] = {"acct", "cd",       "clear", "exit",   "history",
+                                         "jobs", "services", "time",  "timeout"};
+
+constexpr int LOOP_SIGNALS[] = {SIGCHLD, SIGWINCH, SIGINT};
+constexpr int32_t TIMEOUT_STATUS = 124;
+constexpr int32_t TIMEOUT_USAGE_STATUS = 125;
+constexpr int64_t TIMEOUT_KILL_AFTER_NS = 2000000000; // SIGKILL this long after SIGTERM
+
+// Raw waitid from sys.S: returns -errno and also fills the child's rusage.
+extern "C" long real_waitid(idtype_t idtype, id_t id, siginfo_t* info, int options, struct rusage* ru);
+
 struct termios g_orig_termios{};
 
-static std::vector<std::string> g_history{};
+static History g_history{};
 static size_t g_history_index{0};
 
+// Ctrl-R incremental reverse search over the history.
+struct Search
+{
+    bool active{false};
+    std::string query{};
+    size_t match{SIZE_MAX};
+    std::string saved{};
+    size_t saved_pos{0};
+    std::string prompt{};
+};
+static Search g_search{};
+
+static InputReader g_input{};
+static LineEditor g_line{};
+static LineRenderer g_view{};
+
+static ParseCache g_parse_cache{};
+static Arena g_exec_arena{16 * 1024};
+static Expander g_expander{};
+static std::vector<char*> g_fields{};
+static std::vector<char*> g_assigns{};
+static int32_t g_last_status{0};
+
+static CommandIndex g_commands{};
+static std::vector<std::string> g_candidates{};
+static bool g_last_tab{false};
+
+static Accounting g_acct{};
+
+struct Job
+{
+    uint32_t id;
+    pid_t pid;
+    FD pidfd; // wake-up only; empty before Linux 5.3, where SIGCHLD covers it
+    std::string command;
+    std::vector<std::string> argv{}; // for the accounting record
+    Usage usage{};
+};
+
+static EventLoop g_loop{};
+static std::vector<Job> g_jobs{};
+static std::string g_notices{}; // finished jobs, printed above the next prompt
+static ServiceManager g_services{};
+
+// The running foreground command, completed by the reaper.
+struct Foreground
+{
+    pid_t pid{0};
+    bool done{false};
+    siginfo_t info{};
+    struct rusage ru{};
+};
+
+static Foreground g_fg{};
+
 inline static void disable_raw_mode();
 
 inline static void die(std::string_view s)
@@ -44,9 +139,14 @@ inline static void die(std::string_view s)
 
 inline static void enable_raw_mode()
 {
+    static bool registered = false;
     if (tcgetattr(STDIN_FILENO, &g_orig_termios) == -1)
         die("tcgetattr");
-    atexit(disable_raw_mode);
+    if (!registered)
+    {
+        atexit(disable_raw_mode);
+        registered = true;
+    }
 
     struct termios raw{g_orig_termios};
     raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
@@ -56,179 +156,975 @@ inline static void enable_raw_mode()
     raw.c_cc[VMIN] = 1;
     raw.c_cc[VTIME] = 0;
 
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
         die("tcsetattr raw");
+    print(BRACKETED_PASTE_ON);
 }
 
 inline static void disable_raw_mode()
 {
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_orig_termios);
+    print(BRACKETED_PASTE_OFF);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &g_orig_termios);
     print("\r\n");
 }
 
 inline static void add_history(const std::string& command)
 {
-    if (command.empty())
-        return;
-    if (!g_history.empty() && g_history.back() == command)
-    {
-        g_history_index = g_history.size();
-        return;
-    }
-    if (g_history.size() >= MAX_HISTORY)
+    if (g_history.add(command))
+        g_history.persist(command);
+    g_history_index = g_history.size();
+}
+
+inline static void print_history()
+{
+    std::string out{};
+    for (size_t i = 0; i < g_history.size(); ++i)
     {
-        g_history.erase(g_history.begin());
+        out.append(g_history.at(i));
+        out += "\r\n";
+        if (out.size() >= 64 * 1024)
+        {
+            print(out);
+            out.clear();
+        }
     }
-    g_history.push_back(command);
-    g_history_index = g_history.size();
+    print(out);
 }
 
-inline static void handle_cd(const std::vector<std::string>& args)
+inline static int32_t handle_cd(int32_t argc, char** argv)
 {
-    if (args.size() < 2)
+    if (argc < 2)
     {
         const char* home = getenv("HOME");
         if (home == nullptr)
         {
             print_error("ERROR: cd: HOME not set\r\n");
+            return 1;
         }
         else if (chdir(home) != 0)
         {
             print_error("ERROR: cd home: ");
             print_error(strerror(errno));
             print_error("\r\n");
+            return 1;
         }
     }
     else
     {
-        if (chdir(args[1].c_str()) != 0)
+        if (chdir(argv[1]) != 0)
         {
             print_error("ERROR: cd '");
-            print_error(args[1]);
+            print_error(argv[1]);
             print_error("': ");
             print_error(strerror(errno));
             print_error("\r\n");
+            return 1;
         }
     }
+    return 0;
 }
 
-inline static void execute_command(const std::string& command_str)
+// NAME=value as the first segment of a word, before expansion.
+inline static bool is_assignment(const Word& w)
 {
-    if (command_str.empty())
-        return;
+    if (w.count == 0 || w.segs[0].kind != SegKind::Literal || w.segs[0].quoted)
+        return false;
+    std::string_view text(w.segs[0].text, w.segs[0].len);
+    size_t eq = text.find('=');
+    if (eq == std::string_view::npos || eq == 0 || isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+    for (size_t i = 0; i < eq; ++i)
+    {
+        if (!isalnum(static_cast<unsigned char>(text[i])) && text[i] != '_')
+            return false;
+    }
+    return true;
+}
 
-    if (command_str == "exit")
+inline static bool is_builtin(std::string_view name)
+{
+    return std::binary_search(std::begin(BUILTINS), std::end(BUILTINS), name);
+}
+
+inline static int32_t exit_status(const siginfo_t& info)
+{
+    if (info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED)
+        return 128 + info.si_status;
+    return info.si_status;
+}
+
+inline static void job_done(size_t index, const siginfo_t& info, const struct rusage& ru)
+{
+    Job& job = g_jobs[index];
+    if (g_acct.enabled())
     {
-        exit(0);
+        job.usage.end();
+        job.usage.ru = ru;
+        std::vector<char*> argv;
+        for (std::string& a : job.argv)
+            argv.push_back(a.data());
+        g_acct.record(static_cast<int32_t>(argv.size()), argv.data(), exit_status(info), job.usage);
     }
+    char buf[96];
+    int n;
+    if (info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED)
+        n = std::snprintf(buf, sizeof buf, "[%u]  %s  ", job.id, strsignal(info.si_status));
+    else if (info.si_status == 0)
+        n = std::snprintf(buf, sizeof buf, "[%u]  Done  ", job.id);
+    else
+        n = std::snprintf(buf, sizeof buf, "[%u]  Exit %d  ", job.id, info.si_status);
+    g_notices.append(buf, static_cast<size_t>(n));
+    g_notices += job.command;
+    g_notices += "\r\n";
+    if (job.pidfd)
+        g_loop.remove(job.pidfd.get());
+    g_jobs.erase(g_jobs.begin() + static_cast<ptrdiff_t>(index));
+}
 
-    std::vector<std::string> args_storage;
-    std::string current_arg;
-    for (char c : command_str)
+// Every child is reaped here, whichever event noticed the exit; pidfds and
+// SIGCHLD are only wake-ups. Exits are routed to the foreground command, a
+// background job or a service. Anything else is an orphan that init
+// inherited and is simply collected.
+inline static void reap_children()
+{
+    while (true)
     {
-        if (isspace(static_cast<unsigned char>(c)))
+        siginfo_t info{};
+        struct rusage ru{};
+        long r = real_waitid(P_ALL, 0, &info, WEXITED | WNOHANG, &ru);
+        if (r == -EINTR)
+            continue;
+        if (r < 0 || info.si_pid == 0)
+            return;
+
+        if (info.si_pid == g_fg.pid)
         {
-            if (!current_arg.empty())
+            g_fg.done = true;
+            g_fg.info = info;
+            g_fg.ru = ru;
+            continue;
+        }
+        auto job = std::find_if(g_jobs.begin(), g_jobs.end(), [&](const Job& j) { return j.pid == info.si_pid; });
+        if (job != g_jobs.end())
+        {
+            job_done(static_cast<size_t>(job - g_jobs.begin()), info, ru);
+            continue;
+        }
+        g_services.exited(info.si_pid, info);
+    }
+}
+
+inline static void handle_signal(int signo)
+{
+    if (signo == SIGCHLD)
+        reap_children();
+    else if (signo == SIGWINCH)
+        g_view.resized = true;
+    // SIGINT reaches the foreground command directly; the shell carries on.
+}
+
+// Handles any event other than terminal input and a foreground timeout.
+inline static void dispatch(const epoll_event& ev)
+{
+    switch (EventLoop::source(ev))
+    {
+    case Source::Signal:
+        g_loop.drain_signals(handle_signal);
+        break;
+    case Source::Child:
+        reap_children();
+        break;
+    case Source::Service:
+        g_services.on_timer();
+        break;
+    case Source::Input:
+    case Source::Timer:
+        break;
+    }
+}
+
+inline static void print_jobs()
+{
+    std::string out{};
+    for (const Job& job : g_jobs)
+    {
+        char buf[48];
+        int n = std::snprintf(buf, sizeof buf, "[%u]  Running  %d  ", job.id, static_cast<int>(job.pid));
+        out.append(buf, static_cast<size_t>(n));
+        out += job.command;
+        out += "\r\n";
+    }
+    print(out);
+}
+
+// "10", "0.5", "2m": seconds with an optional s/m/h/d suffix, as in
+// coreutils timeout.
+inline static bool parse_duration(const char* text, int64_t& ns)
+{
+    char* end = nullptr;
+    double value = strtod(text, &end);
+    if (end == text || !std::isfinite(value) || value < 0)
+        return false;
+    double scale = 1;
+    switch (*end)
+    {
+    case '\0':
+    case 's':
+        break;
+    case 'm':
+        scale = 60;
+        break;
+    case 'h':
+        scale = 3600;
+        break;
+    case 'd':
+        scale = 86400;
+        break;
+    default:
+        return false;
+    }
+    if (*end != '\0' && end[1] != '\0')
+        return false;
+    double total = value * scale * 1e9;
+    ns = total >= static_cast<double>(INT64_MAX) ? INT64_MAX : static_cast<int64_t>(total);
+    return true;
+}
+
+inline static int32_t handle_acct(int32_t argc, char** argv)
+{
+    if (argc < 2)
+    {
+        print(g_acct.enabled() ? "accounting on\r\n" : "accounting off\r\n");
+        return 0;
+    }
+    if (std::string_view(argv[1]) == "off")
+    {
+        g_acct.close();
+        return 0;
+    }
+    if (!g_acct.open(argv[1]))
+    {
+        print_error("ERROR: acct '");
+        print_error(argv[1]);
+        print_error("': ");
+        print_error(strerror(errno));
+        print_error("\r\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Runs builtins in-process. Returns false if argv[0] is not a builtin.
+inline static bool run_builtin(int32_t argc, char** argv, int32_t& status)
+{
+    std::string_view name = argv[0];
+    if (name == "acct")
+    {
+        status = handle_acct(argc, argv);
+    }
+    else if (name == "exit")
+    {
+        exit(argc > 1 ? atoi(argv[1]) : g_last_status);
+    }
+    else if (name == "cd")
+    {
+        status = handle_cd(argc, argv);
+    }
+    else if (name == "history")
+    {
+        print_history();
+        status = 0;
+    }
+    else if (name == "jobs")
+    {
+        print_jobs();
+        status = 0;
+    }
+    else if (name == "services")
+    {
+        std::string out = "UNIT                 TYPE     STATE        PID RESTARTS   SETTLED\r\n";
+        g_services.describe(out);
+        print(out);
+        status = 0;
+    }
+    else if (name == "clear")
+    {
+        clear_screen();
+        status = 0;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+inline static int32_t run_argv(int32_t argc, char** argv, Usage& usage, int64_t timeout_ns);
+
+// Forks and execs argv with the signal mask the shell started with.
+// Background children read /dev/null and ignore SIGINT, as in any shell
+// without job control; builtins run there in a subshell.
+inline static pid_t spawn(int32_t argc, char** argv, size_t nassign, bool background)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        if (pid < -1) // raw fork from sys.S returns -errno
+            errno = -pid;
+        print_error("ERROR: fork: ");
+        print_error(strerror(errno));
+        print_error("\r\n");
+        return -1;
+    }
+    if (pid > 0)
+        return pid;
+
+    sigprocmask(SIG_SETMASK, &g_loop.old_mask, nullptr);
+    signal(SIGINT, background ? SIG_IGN : SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    if (background)
+    {
+        int null = open("/dev/null", O_RDONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDIN_FILENO);
+            close(null);
+        }
+        if (is_builtin(argv[0]))
+        {
+            sigprocmask(SIG_BLOCK, &g_loop.mask, nullptr);
+            g_jobs.clear();
+            g_services.detach();
+            g_loop.reopen();
+            Usage usage{};
+            _exit(run_argv(argc, argv, usage, 0));
+        }
+    }
+    for (size_t i = 0; i < nassign; ++i)
+        putenv(g_assigns[i]);
+    execvp(argv[0], argv);
+    print_error("ERROR: execvp '");
+    print_error(argv[0]);
+    print_error("': ");
+    print_error(strerror(errno));
+    print_error("\r\n");
+    _exit(127);
+}
+
+// Waits for the foreground child inside the event loop, so background jobs
+// are still reaped and resizes noticed meanwhile. With a timeout, a timerfd
+// sends SIGTERM and, TIMEOUT_KILL_AFTER_NS later, SIGKILL. Terminal input
+// is left queued for the prompt.
+inline static int32_t wait_foreground(pid_t pid, struct rusage& ru, int64_t timeout_ns)
+{
+    g_fg = {};
+    g_fg.pid = pid;
+    FD pidfd = open_pidfd(pid);
+    if (pidfd)
+        g_loop.add(pidfd.get(), Source::Child, 0);
+    FD timer{};
+    if (timeout_ns > 0)
+    {
+        timer = make_timer(timeout_ns);
+        g_loop.add(timer.get(), Source::Timer, 0);
+    }
+    g_loop.watch_input(false);
+
+    bool timed_out = false;
+    while (!g_fg.done)
+    {
+        int n = g_loop.wait(-1);
+        for (int i = 0; i < n; ++i)
+        {
+            const epoll_event& ev = g_loop.events[i];
+            if (EventLoop::source(ev) != Source::Timer)
             {
-                args_storage.push_back(current_arg);
-                current_arg.clear();
+                dispatch(ev);
+                continue;
             }
+            clear_timer(timer.get());
+            kill(pid, timed_out ? SIGKILL : SIGTERM);
+            if (!timed_out)
+                arm_timer(timer.get(), TIMEOUT_KILL_AFTER_NS);
+            timed_out = true;
         }
-        else
+    }
+
+    g_loop.watch_input(true);
+    if (pidfd)
+        g_loop.remove(pidfd.get());
+    if (timer)
+        g_loop.remove(timer.get());
+    g_fg.pid = 0;
+    ru = g_fg.ru;
+    const siginfo_t& info = g_fg.info;
+    bool killed = info.si_code == CLD_KILLED && info.si_status == SIGKILL;
+    if (timed_out && !killed)
+        return TIMEOUT_STATUS;
+    return exit_status(info);
+}
+
+inline static int32_t run_external(int32_t argc, char** argv, size_t nassign, struct rusage& ru, int64_t timeout_ns)
+{
+    pid_t pid = spawn(argc, argv, nassign, false);
+    if (pid < 0)
+        return 1;
+    return wait_foreground(pid, ru, timeout_ns);
+}
+
+inline static int32_t start_job(int32_t argc, char** argv)
+{
+    Usage usage{};
+    usage.begin();
+    pid_t pid = spawn(argc, argv, g_assigns.size(), true);
+    if (pid < 0)
+        return 1;
+
+    uint32_t id = 1;
+    for (const Job& j : g_jobs)
+        id = std::max(id, j.id + 1);
+    Job job{id, pid, open_pidfd(pid), {}, std::vector<std::string>(argv, argv + argc), usage};
+    for (int32_t i = 0; i < argc; ++i)
+    {
+        if (i > 0)
+            job.command += ' ';
+        job.command += argv[i];
+    }
+    if (job.pidfd)
+        g_loop.add(job.pidfd.get(), Source::Child, id);
+    g_jobs.push_back(std::move(job));
+    g_expander.last_background = pid;
+
+    char buf[32];
+    int n = std::snprintf(buf, sizeof buf, "[%u] %d\r\n", id, static_cast<int>(pid));
+    print({buf, static_cast<size_t>(n)});
+    return 0;
+}
+
+// Runs argv as a builtin or external command and measures it. `time` and
+// `timeout` are handled here so that usage (and the accounting record)
+// describe the command they wrap rather than the builtin.
+inline static int32_t run_argv(int32_t argc, char** argv, Usage& usage, int64_t timeout_ns)
+{
+    std::string_view name = argv[0];
+    if (name == "time")
+    {
+        int32_t status = 0;
+        usage = {};
+        if (argc > 1)
+            status = run_argv(argc - 1, argv + 1, usage, timeout_ns);
+        print_usage(usage);
+        return status;
+    }
+    if (name == "timeout")
+    {
+        int64_t ns = 0;
+        if (argc < 3 || !parse_duration(argv[1], ns))
         {
-            current_arg += c;
+            print_error("ERROR: timeout: usage: timeout DURATION COMMAND [ARG]...\r\n");
+            return TIMEOUT_USAGE_STATUS;
         }
+        return run_argv(argc - 2, argv + 2, usage, ns);
     }
-    if (!current_arg.empty())
+
+    usage.begin();
+    struct rusage before{};
+    getrusage(RUSAGE_SELF, &before);
+
+    int32_t status = 0;
+    if (run_builtin(argc, argv, status))
     {
-        args_storage.push_back(current_arg);
+        struct rusage after{};
+        getrusage(RUSAGE_SELF, &after);
+        usage.self_delta(before, after);
     }
+    else
+    {
+        status = run_external(argc, argv, g_assigns.size(), usage.ru, timeout_ns);
+    }
+    usage.end();
+    return status;
+}
 
-    if (args_storage.empty())
-        return;
+// Expands and runs one simple command. argv and every expanded word come
+// from the per-line arena.
+inline static int32_t run_command(const Command& cmd)
+{
+    g_assigns.clear();
+    g_fields.clear();
+    uint32_t w = 0;
+    for (; w < cmd.count && is_assignment(cmd.words[w]); ++w)
+        g_assigns.push_back(g_expander.join(cmd.words[w]));
+    for (; w < cmd.count; ++w)
+        g_expander.expand(cmd.words[w], g_fields);
 
-    if (args_storage[0] == "cd")
+    if (g_fields.empty())
     {
-        handle_cd(args_storage);
+        // Bare assignments set shell (and exported) variables.
+        for (char* a : g_assigns)
+        {
+            char* eq = strchr(a, '=');
+            *eq = '\0';
+            setenv(a, eq + 1, 1);
+            *eq = '=';
+        }
+        return 0;
+    }
+
+    size_t argc = g_fields.size();
+    char** argv = g_exec_arena.array<char*>(argc + 1);
+    memcpy(argv, g_fields.data(), argc * sizeof(char*));
+    argv[argc] = nullptr;
+
+    if (cmd.background)
+        return start_job(static_cast<int32_t>(argc), argv);
+
+    Usage usage{};
+    int32_t status = run_argv(static_cast<int32_t>(argc), argv, usage, 0);
+    if (g_acct.enabled())
+        g_acct.record(static_cast<int32_t>(argc), argv, status, usage);
+    return status;
+}
+
+inline static void execute_command(std::string_view line)
+{
+    const char* error = nullptr;
+    const Script* script = g_parse_cache.get(line, error);
+    if (script == nullptr)
+    {
+        print_error("ERROR: ");
+        print_error(error);
+        print_error("\r\n");
+        g_last_status = 2;
         return;
     }
-    else if (args_storage[0] == "history")
+
+    g_expander.arena = &g_exec_arena;
+    int32_t status = g_last_status;
+    for (uint32_t k = 0; k < script->count; ++k)
+    {
+        const Command& cmd = script->commands[k];
+        if ((cmd.link == Link::And && status != 0) || (cmd.link == Link::Or && status == 0))
+            continue;
+        g_expander.last_status = status;
+        status = run_command(cmd);
+    }
+    g_last_status = status;
+    g_exec_arena.reset();
+}
+
+inline static void show_candidates(size_t skip)
+{
+    size_t width = 0;
+    for (const auto& c : g_candidates)
+        width = std::max(width, c.size() - skip);
+    size_t per_row = std::max<size_t>(1, terminal_columns() / (width + 2));
+
+    std::string out{};
+    for (size_t i = 0; i < g_candidates.size(); ++i)
+    {
+        std::string_view c = g_candidates[i];
+        out.append(c.substr(skip));
+        if ((i + 1) % per_row == 0 || i + 1 == g_candidates.size())
+            out += "\r\n";
+        else
+            out.append(width + 2 - (c.size() - skip), ' ');
+    }
+    g_view.finish("");
+    print(out);
+    g_view.begin();
+}
+
+// Completes the word before the cursor: a command name in command position,
+// otherwise a path. The inserted text is escaped for the parser. A second
+// Tab on an ambiguous word lists the candidates. Returns true when the word
+// was left ambiguous.
+inline static bool complete(bool repeated)
+{
+    size_t pos = g_line.pos;
+    CompletionWord word = word_before(g_line.buf, pos);
+
+    g_candidates.clear();
+    size_t skip = 0;
+    if (word.command && word.text.find('/') == std::string::npos)
+    {
+        g_commands.refresh(BUILTINS);
+        g_commands.lookup(word.text, g_candidates);
+    }
+    else
+    {
+        skip = complete_path(word.text, g_candidates);
+    }
+
+    if (g_candidates.empty())
+    {
+        print("\a");
+        return false;
+    }
+
+    std::string replacement{};
+    if (g_candidates.size() == 1)
+    {
+        append_escaped_word(replacement, g_candidates[0]);
+        if (replacement.back() != '/')
+            replacement += ' ';
+    }
+    else
     {
-        for (const auto& hist : g_history)
+        size_t common = common_prefix(g_candidates);
+        if (common <= word.text.size())
         {
-            print(hist);
-            print("\r\n");
+            if (repeated)
+                show_candidates(skip);
+            else
+                print("\a");
+            return true;
         }
+        append_escaped_word(replacement, std::string_view(g_candidates[0]).substr(0, common));
+    }
+    g_line.pos = word.start;
+    g_line.buf.erase(word.start, pos - word.start);
+    g_line.insert(replacement);
+    return false;
+}
+
+inline static void redraw()
+{
+    if (!g_search.active)
+    {
+        g_view.render(PROMPT_PRELUDE, g_line.buf, g_line.pos);
         return;
     }
-    else if (args_storage[0] == "clear")
+    g_search.prompt = g_search.match == SIZE_MAX && !g_search.query.empty() ? "(failed reverse-i-search)`"
+                                                                             : "(reverse-i-search)`";
+    g_search.prompt += g_search.query;
+    g_search.prompt += "': ";
+    g_view.render(g_search.prompt, g_line.buf, g_line.pos);
+}
+
+inline static void search_show(size_t from)
+{
+    size_t found = g_history.search(g_search.query, from);
+    if (found == SIZE_MAX)
     {
-        clear_screen();
+        g_search.match = SIZE_MAX;
         return;
     }
+    g_search.match = found;
+    std::string_view entry = g_history.at(found);
+    g_line.set(entry);
+    g_line.pos = entry.find(g_search.query);
+}
+
+// Handles a key while Ctrl-R search is active. Returns false when the key
+// ends the search and should be processed as a normal key.
+inline static bool search_key(int32_t key)
+{
+    switch (key)
+    {
+    case CTR_R:
+        if (g_search.match != SIZE_MAX)
+            search_show(g_search.match);
+        return true;
+    case BACKSPACE:
+    case CTR_H:
+        g_search.query.erase(utf8::prev(g_search.query, g_search.query.size()));
+        search_show(g_history.size());
+        return true;
+    case CTR_G:
+    case CTR_C:
+        g_search.active = false;
+        g_line.set(g_search.saved);
+        g_line.pos = g_search.saved_pos;
+        return true;
+    default:
+        if (utf8::printable(key))
+        {
+            char c[4];
+            g_search.query.append(c, utf8::encode(static_cast<uint32_t>(key), c));
+            // The current match may still contain the longer query.
+            search_show(g_search.match == SIZE_MAX ? g_history.size() : g_search.match + 1);
+            return true;
+        }
+        g_search.active = false;
+        if (g_search.match != SIZE_MAX)
+            g_history_index = g_search.match;
+        return key == KEY_ESCAPE;
+    }
+}
 
-    std::vector<char*> argv;
-    for (const auto& arg : args_storage)
+// Blocks in the event loop until terminal input is readable, handling
+// signals, finished jobs and service restarts meanwhile. Returns false if
+// only those arrived.
+inline static bool wait_for_input()
+{
+    bool ready = !g_loop.input_pollable;
+    int n = g_loop.wait(ready ? 0 : -1);
+    for (int i = 0; i < n; ++i)
     {
-        argv.push_back(const_cast<char*>(arg.c_str()));
+        if (EventLoop::source(g_loop.events[i]) == Source::Input)
+            ready = true;
+        else
+            dispatch(g_loop.events[i]);
     }
-    argv.push_back(nullptr);
+    return ready;
+}
 
-    pid_t pid = fork();
-    if (pid == -1)
+// Starts the units in dir and runs the event loop until all of them have
+// settled, then reports how long it took to get to the shell. Units still
+// unsettled at the deadline are listed and left running; the prompt comes up
+// anyway.
+inline static void boot_services(const char* dir, int64_t deadline_ns)
+{
+    if (!g_services.load(dir))
     {
-        print_error("ERROR: fork: ");
+        print_error("ERROR: init: unit directory '");
+        print_error(dir);
+        print_error("': ");
         print_error(strerror(errno));
         print_error("\r\n");
         return;
     }
-    else if (pid == 0)
+    g_loop.watch_input(false);
+    g_services.start(g_loop);
+    FD deadline{};
+    if (deadline_ns > 0)
     {
-
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        if (execvp(argv[0], argv.data()) == -1)
+        deadline = make_timer(deadline_ns);
+        g_loop.add(deadline.get(), Source::Timer, 0);
+    }
+    bool expired = false;
+    while (g_services.booting() && !expired)
+    {
+        int n = g_loop.wait(-1);
+        for (int i = 0; i < n; ++i)
         {
-            print_error("ERROR: execvp '");
-            print_error(argv[0]);
-            print_error("': ");
-            print_error(strerror(errno));
-            print_error("\r\n");
-            _exit(1);
+            if (EventLoop::source(g_loop.events[i]) == Source::Timer)
+                expired = true;
+            else
+                dispatch(g_loop.events[i]);
         }
     }
-    else
+    if (deadline)
+        g_loop.remove(deadline.get());
+    g_loop.watch_input(true);
+
+    if (g_services.booting())
+    {
+        print_error("ERROR: init: boot deadline passed; not settled: ");
+        print_error(g_services.unsettled());
+        print_error("\r\n");
+        return;
+    }
+
+    char buf[128];
+    int n = std::snprintf(buf, sizeof buf, "init: %zu units settled in %.1f ms; shell ready %.1f ms after boot\r\n",
+                          g_services.units.size(),
+                          static_cast<double>(g_services.boot_end_ns - g_services.boot_start_ns) / 1e6,
+                          static_cast<double>(monotonic_ns()) / 1e6);
+    print({buf, static_cast<size_t>(n)});
+}
+
+// Applies one decoded key. Returns false when the shell should exit.
+inline static bool handle_key(int32_t key)
+{
+    bool repeated_tab = g_last_tab;
+    g_last_tab = false;
+
+    if (g_search.active && search_key(key))
+        return true;
+
+    switch (key)
     {
+    case '\t':
+        if (g_input.pasting)
+        {
+            g_line.insert(" ");
+            break;
+        }
+        g_last_tab = complete(repeated_tab);
+        break;
+
+    case '\r':
+    case '\n': {
+        redraw();
+        g_view.finish("");
+        print(BRACKETED_PASTE_OFF);
+        // TCSADRAIN rather than TCSAFLUSH: input typed or pasted ahead of
+        // the prompt must survive the switch to cooked mode and back.
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &g_orig_termios);
+        std::string command = std::move(g_line.buf);
+        g_line.clear();
+        if (!command.empty())
+        {
+            add_history(command);
+            execute_command(command);
+        }
+        g_line.buf = std::move(command);
+        g_line.clear();
+        enable_raw_mode();
+        g_view.begin();
+        g_history_index = g_history.size();
+        break;
+    }
+
+    case BACKSPACE:
+    case CTR_H:
+        g_line.backspace();
+        break;
+
+    case KEY_DELETE:
+        g_line.del();
+        break;
+
+    case CTR_C:
+        redraw();
+        g_view.finish("^C");
+        g_line.clear();
+        g_history_index = g_history.size();
+        break;
+
+    case CTR_D:
+        if (g_line.buf.empty())
+            return false;
+        g_line.del();
+        break;
+
+    case CTR_A:
+    case KEY_HOME:
+        g_line.home();
+        break;
+
+    case CTR_E:
+    case KEY_END:
+        g_line.end();
+        break;
+
+    case CTR_B:
+    case KEY_LEFT:
+        g_line.left();
+        break;
+
+    case CTR_F:
+    case KEY_RIGHT:
+        g_line.right();
+        break;
+
+    case KEY_ALT | 'b':
+    case KEY_CTRL_LEFT:
+        g_line.word_left();
+        break;
+
+    case KEY_ALT | 'f':
+    case KEY_CTRL_RIGHT:
+        g_line.word_right();
+        break;
+
+    case CTR_K:
+        g_line.kill_to_end();
+        break;
+
+    case CTR_U:
+        g_line.kill_to_start();
+        break;
+
+    case CTR_W:
+        g_line.kill_word_back();
+        break;
+
+    case KEY_ALT | 'd':
+        g_line.kill_word_forward();
+        break;
+
+    case CTR_Y:
+        g_line.yank();
+        break;
+
+    case CTR_R:
+        g_search.active = true;
+        g_search.query.clear();
+        g_search.match = SIZE_MAX;
+        g_search.saved = g_line.buf;
+        g_search.saved_pos = g_line.pos;
+        break;
+
+    case CTR_L:
+        clear_screen();
+        g_view.begin();
+        break;
+
+    case KEY_UP:
+        if (g_history_index > 0)
+        {
+            g_history_index--;
+            g_line.set(g_history.at(g_history_index));
+        }
+        break;
 
-        int32_t status{};
-        if (waitpid(pid, &status, 0) == -1)
+    case KEY_DOWN:
+        if (g_history_index < g_history.size())
         {
-            if (errno != EINTR)
+            g_history_index++;
+            if (g_history_index == g_history.size())
+            {
+                g_line.clear();
+            }
+            else
             {
-                print_error("ERROR: waitpid: ");
-                print_error(strerror(errno));
-                print_error("\r\n");
+                g_line.set(g_history.at(g_history_index));
             }
         }
+        break;
+
+    default:
+        if (utf8::printable(key))
+        {
+            char c[4];
+            g_line.insert({c, utf8::encode(static_cast<uint32_t>(key), c)});
+        }
+        break;
     }
+    return true;
 }
 
 int32_t main(void)
 {
-    std::string command{};
-    command.reserve(PREALLOC_COMMAND_SIZE);
+    g_line.buf.reserve(PREALLOC_COMMAND_SIZE);
+    g_history.load(history_path());
+    g_history_index = g_history.size();
+    if (const char* acct = getenv(ACCT_ENV))
+        g_acct.open(acct);
+    if (!g_loop.init(LOOP_SIGNALS, std::size(LOOP_SIGNALS)))
+        die("event loop");
+    if (getpid() == 1 || getenv(UNIT_DIR_ENV))
+    {
+        const char* dir = getenv(UNIT_DIR_ENV);
+        const char* timeout = getenv(BOOT_TIMEOUT_ENV);
+        int64_t deadline_ns = BOOT_TIMEOUT_NS;
+        if (timeout && !parse_duration(timeout, deadline_ns))
+            print_error("ERROR: init: bad INIT_BOOT_TIMEOUT, using the default\r\n");
+        boot_services(dir ? dir : DEFAULT_UNIT_DIR, deadline_ns);
+    }
 
     enable_raw_mode();
 
     while (true)
     {
-        clear_line();
-        print(PROMPT_PRELUDE);
-        print(command);
+        if (!g_notices.empty())
+        {
+            g_view.erase();
+            print(g_notices);
+            g_notices.clear();
+        }
+        redraw();
 
-        char c = '\0';
-        ssize_t nread = read(STDIN_FILENO, &c, 1);
+        if (!wait_for_input())
+            continue;
 
+        // Take everything the terminal has queued and apply it before the
+        // next redraw; pasting a script costs one read per buffer, not per
+        // byte.
+        ssize_t nread = g_input.fill();
         if (nread == -1)
         {
             if (errno == EINTR)
@@ -240,94 +1136,12 @@ int32_t main(void)
             break;
         }
 
-        switch (c)
+        while (g_input.pending())
         {
-        case '\r':
-        case '\n':
-            print("\r\n");
-            tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_orig_termios);
-            if (!command.empty())
-            {
-                add_history(command);
-                execute_command(command);
-            }
-            enable_raw_mode();
-            command.clear();
-            g_history_index = g_history.size();
-            break;
-
-        case BACKSPACE:
-            if (!command.empty())
-            {
-                command.pop_back();
-                print("\b \b");
-            }
-            break;
-
-        case CTR_C:
-            print("^C\r\n");
-            command.clear();
-            g_history_index = g_history.size();
-            break;
-
-        case CTR_D:
-            if (command.empty())
-            {
-                goto exit_loop;
-            }
-            break;
-
-        case ESC_SEQ: {
-            char seq[3];
-            if (read(STDIN_FILENO, &seq[0], 1) != 1)
-                continue;
-            if (read(STDIN_FILENO, &seq[1], 1) != 1)
-                continue;
-
-            if (seq[0] == '[')
-            {
-                switch (seq[1])
-                {
-                case 'A':
-                    if (g_history_index > 0)
-                    {
-                        g_history_index--;
-                        command = g_history[g_history_index];
-                    }
-                    break;
-                case 'B':
-                    if (g_history_index < g_history.size())
-                    {
-                        g_history_index++;
-                        if (g_history_index == g_history.size())
-                        {
-                            command.clear();
-                        }
-                        else
-                        {
-                            command = g_history[g_history_index];
-                        }
-                    }
-                    break;
-                }
-            }
-            break;
-        }
-
-        default:
-            if (isprint(static_cast<unsigned char>(c)))
-            {
-                command += c;
-                if (write(STDOUT_FILENO, &c, 1) == -1 && errno != EINTR)
-                {
-                    die("write echo");
-                }
-            }
-            break;
+            if (!handle_key(g_input.next_key()))
+                return 0;
         }
     }
 
-exit_loop:
-
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#include "include/scan.hpp"
+#include "include/util.hpp"
+
+// wc [-l] [-w] [-c] [file...]: newlines, words and bytes; all three without
+// options, a total line for several files.
+struct Counts
+{
+    size_t lines{0};
+    size_t words{0};
+    size_t bytes{0};
+};
+
+struct Show
+{
+    bool lines{false};
+    bool words{false};
+    bool bytes{false};
+};
+
+static bool count_fd(int fd, const Show& show, std::vector<char>& buf, Counts& c)
+{
+    // Byte counts of regular files come from the size alone.
+    struct stat st{};
+    if (!show.lines && !show.words && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        c.bytes = static_cast<size_t>(st.st_size - (pos > 0 ? pos : 0));
+        return true;
+    }
+    bool in_word = false;
+    while (true)
+    {
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return true;
+        size_t len = static_cast<size_t>(n);
+        c.bytes += len;
+        if (show.lines)
+            c.lines += scan::count_byte(buf.data(), len, '\n');
+        if (show.words)
+            c.words += scan::count_words(buf.data(), len, in_word);
+    }
+}
+
+static void print_counts(const Show& show, const Counts& c, std::string_view name)
+{
+    char line[96];
+    int n = 0;
+    if (show.lines)
+        n += std::snprintf(line + n, sizeof line - static_cast<size_t>(n), " %7zu", c.lines);
+    if (show.words)
+        n += std::snprintf(line + n, sizeof line - static_cast<size_t>(n), " %7zu", c.words);
+    if (show.bytes)
+        n += std::snprintf(line + n, sizeof line - static_cast<size_t>(n), " %7zu", c.bytes);
+    print(std::string_view(line + 1, static_cast<size_t>(n - 1)));
+    if (!name.empty())
+    {
+        print(" ");
+        print(name);
+    }
+    print("\n");
+}
+
+int32_t main(int32_t argc, char* argv[])
+{
+    auto args = make_args(argc, argv);
+    auto prog = prog_name(args[0]);
+
+    Show show;
+    std::vector<std::string_view> files;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        std::string_view a = args[i];
+        if (a.size() < 2 || a[0] != '-' || !files.empty())
+        {
+            files.push_back(a);
+            continue;
+        }
+        for (char f : a.substr(1))
+        {
+            if (f == 'l')
+                show.lines = true;
+            else if (f == 'w')
+                show.words = true;
+            else if (f == 'c')
+                show.bytes = true;
+            else
+            {
+                print_error("ERROR: ");
+                print_error(prog);
+                print_error(": unknown option '");
+                print_error(a);
+                print_error("'\r\n");
+                return 1;
+            }
+        }
+    }
+    if (!show.lines && !show.words && !show.bytes)
+        show = {true, true, true};
+
+    std::vector<char> buf(scan::CHUNK_SIZE);
+    if (files.empty())
+    {
+        Counts c;
+        if (!count_fd(STDIN_FILENO, show, buf, c))
+        {
+            print_errno(prog, "read", "-");
+            return 1;
+        }
+        print_counts(show, c, {});
+        return 0;
+    }
+
+    int32_t ret = 0;
+    Counts total;
+    for (std::string_view name : files)
+    {
+        FD file(name == "-" ? dup(STDIN_FILENO) : open(name.data(), O_RDONLY | O_CLOEXEC));
+        Counts c;
+        if (!file)
+        {
+            print_errno(prog, "open", name);
+            ret = 1;
+            continue;
+        }
+        if (!count_fd(file.get(), show, buf, c))
+        {
+            print_errno(prog, "read", name);
+            ret = 1;
+            continue;
+        }
+        print_counts(show, c, name);
+        total.lines += c.lines;
+        total.words += c.words;
+        total.bytes += c.bytes;
+    }
+    if (files.size() > 1)
+        print_counts(show, total, "total");
+    return ret;
+}
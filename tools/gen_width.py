@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Writes src/include/width_table.hpp, the terminal width of every code point
+# below 0x40000 from the running Python's Unicode database:
+#
+#   tools/gen_width.py > src/include/width_table.hpp
+#
+# 0 for combining and format characters (Mn, Me, Cf except the soft hyphen
+# and the visible prepended concatenation marks) and Hangul medial/final
+# jamo, 2 for East Asian Wide and Fullwidth, 1 for the rest. The table has
+# two stages: WIDTH_BLOCKS maps each 128-code-point block to one of the
+# distinct blocks in WIDTH_BITS, four 2-bit widths per byte.
+
+import sys
+import unicodedata
+
+LIMIT = 0x40000
+SHIFT = 7
+BLOCK = 1 << SHIFT
+PREPENDED_MARKS = {0x0600, 0x0601, 0x0602, 0x0603, 0x0604, 0x0605, 0x06DD, 0x070F, 0x0890, 0x0891, 0x08E2, 0x110BD,
+                   0x110CD}
+
+
+def width(cp):
+    c = chr(cp)
+    if cp == 0x00AD or cp in PREPENDED_MARKS:
+        return 1
+    jamo = 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF
+    if unicodedata.category(c) in ("Mn", "Me", "Cf") or jamo or cp == 0x200B:
+        return 0
+    if unicodedata.east_asian_width(c) in ("W", "F"):
+        return 2
+    return 1
+
+
+def main():
+    index, blocks, bits = [], {}, []
+    for b in range(LIMIT >> SHIFT):
+        widths = tuple(width(cp) for cp in range(b << SHIFT, (b + 1) << SHIFT))
+        if widths not in blocks:
+            blocks[widths] = len(blocks)
+            for i in range(0, BLOCK, 4):
+                bits.append(widths[i] | widths[i + 1] << 2 | widths[i + 2] << 4 | widths[i + 3] << 6)
+        index.append(blocks[widths])
+    assert len(blocks) < 256
+
+    out = sys.stdout
+    out.write("#ifndef WIDTH_TABLE_HPP\n#define WIDTH_TABLE_HPP\n\n")
+    out.write("// Generated by tools/gen_width.py from Unicode %s; do not edit.\n\n" % unicodedata.unidata_version)
+    out.write("#include <cstdint>\n\nnamespace utf8\n{\n\n")
+    out.write("constexpr uint32_t WIDTH_TABLE_LIMIT = 0x%x;\n" % LIMIT)
+    out.write("constexpr unsigned WIDTH_BLOCK_SHIFT = %d;\n\n" % SHIFT)
+    for name, data in (("WIDTH_BLOCKS", index), ("WIDTH_BITS", bits)):
+        out.write("constexpr uint8_t %s[%d] = {\n" % (name, len(data)))
+        for i in range(0, len(data), 16):
+            out.write("    " + ", ".join("0x%02x" % v for v in data[i : i + 16]) + ",\n")
+        out.write("};\n\n")
+    out.write("} // namespace utf8\n\n#endif // WIDTH_TABLE_HPP\n")
+
+
+main()
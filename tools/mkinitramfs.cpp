@@ -0,0 +1,411 @@
+// Writes the initramfs as a newc cpio archive, optionally compressed.
+//
+//   mkinitramfs [-o out] [-c none|gzip|lz4|zstd] [-l level] [-a align] spec...
+//
+// Specs use the kernel's gen_init_cpio syntax, one entry per line:
+//
+//   dir   <name> <mode> <uid> <gid>
+//   file  <name> <location> <mode> <uid> <gid> [<link name>...]
+//   slink <name> <target> <mode> <uid> <gid>
+//   nod   <name> <mode> <uid> <gid> <b|c> <major> <minor>
+//   pipe  <name> <mode> <uid> <gid>
+//   sock  <name> <mode> <uid> <gid>
+//
+// ${VAR} in a location is taken from the environment. The output only
+// depends on the spec and file contents: entries are sorted by name, inode
+// numbers follow that order, and every mtime is $SOURCE_DATE_EPOCH (or 0).
+// Missing parent directories are added. Hard links are only made for the
+// <link name>s of a file entry: they share its inode and the data is stored
+// once, with the first name, which is what the kernel's unpacker expects.
+// The data of files of at least <align> bytes starts on an <align> boundary
+// of the uncompressed stream (default 4096); the name field is padded with
+// NULs to get there. Alignment is best-effort: the kernel skips entries whose
+// name field is longer than PATH_MAX, so a file whose padding would exceed
+// that is stored unaligned.
+//
+// Compressed output is produced by piping the archive through the external
+// compressor, with the flags the kernel's decompressors accept.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/util.hpp"
+
+constexpr size_t HEADER_SIZE = 110;
+constexpr size_t DEFAULT_ALIGN = 4096;
+constexpr size_t NAME_FIELD_MAX = 4096; // PATH_MAX in the kernel's unpacker
+constexpr uint32_t FIRST_INO = 721;
+
+struct Entry
+{
+    std::string name; // without the leading '/'
+    uint32_t mode{0};
+    uint32_t uid{0};
+    uint32_t gid{0};
+    uint32_t rdev_major{0};
+    uint32_t rdev_minor{0};
+    std::string target; // symlink target
+    int blob{-1};       // index into Archive::blobs for regular files
+};
+
+struct Blob
+{
+    std::string data;
+    uint32_t ino{0};
+    uint32_t links{0};
+    bool written{false};
+};
+
+struct Compressor
+{
+    const char* name;
+    const char* program;
+    const char* flags; // besides -c and the level
+    int level;
+};
+
+// lz4 must be the legacy frame format for the kernel; gzip -n drops the
+// embedded name and timestamp.
+constexpr Compressor COMPRESSORS[] = {
+    {"none", nullptr, nullptr, 0},
+    {"gzip", "gzip", "-n", 9},
+    {"lz4", "lz4", "-l", 9},
+    {"zstd", "zstd", "-q", 19},
+};
+
+struct Archive
+{
+    std::vector<Entry> entries;
+    std::vector<Blob> blobs;
+    std::string out;
+    size_t align{DEFAULT_ALIGN};
+    uint32_t mtime{0};
+
+    bool has(const std::string& name) const
+    {
+        return std::any_of(entries.begin(), entries.end(), [&](const Entry& e) { return e.name == name; });
+    }
+
+    int add_blob(std::string data)
+    {
+        int id = static_cast<int>(blobs.size());
+        blobs.push_back(Blob{std::move(data), 0, 1, false});
+        return id;
+    }
+
+    // Adds 0755 root-owned directories for every missing ancestor.
+    void add_parents()
+    {
+        std::vector<Entry> missing;
+        for (const Entry& e : entries)
+        {
+            for (size_t slash = e.name.find('/'); slash != std::string::npos; slash = e.name.find('/', slash + 1))
+            {
+                std::string dir = e.name.substr(0, slash);
+                bool known = has(dir) || std::any_of(missing.begin(), missing.end(),
+                                                     [&](const Entry& m) { return m.name == dir; });
+                if (known)
+                    continue;
+                Entry d;
+                d.name = dir;
+                d.mode = S_IFDIR | 0755;
+                missing.push_back(d);
+            }
+        }
+        entries.insert(entries.end(), missing.begin(), missing.end());
+    }
+
+    void header(uint32_t ino, const Entry& e, uint32_t nlink, size_t size, size_t namesize)
+    {
+        char buf[HEADER_SIZE + 1];
+        std::snprintf(buf, sizeof buf, "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X", ino, e.mode, e.uid,
+                      e.gid, nlink, mtime, static_cast<uint32_t>(size), 0u, 0u, e.rdev_major, e.rdev_minor,
+                      static_cast<uint32_t>(namesize), 0u);
+        out.append(buf, HEADER_SIZE);
+    }
+
+    void pad(size_t to)
+    {
+        out.append((to - out.size() % to) % to, '\0');
+    }
+
+    void write_entry(uint32_t ino, const Entry& e, uint32_t nlink, const std::string& data)
+    {
+        size_t namesize = e.name.size() + 1;
+        if (S_ISREG(e.mode) && data.size() >= align)
+        {
+            // Extra NULs in the name push the data onto the boundary; the
+            // name is still terminated, so unpackers ignore them.
+            // Past NAME_FIELD_MAX the kernel would drop the entry.
+            size_t start = out.size() + HEADER_SIZE + namesize;
+            size_t padding = (start + align - 1) / align * align - start;
+            if (namesize + padding <= NAME_FIELD_MAX)
+                namesize += padding;
+        }
+        header(ino, e, nlink, data.size(), namesize);
+        out += e.name;
+        out.append(namesize - e.name.size(), '\0');
+        pad(4);
+        out += data;
+        pad(4);
+    }
+
+    void write()
+    {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+        uint32_t ino = FIRST_INO;
+        for (const Entry& e : entries)
+        {
+            if (e.blob < 0)
+            {
+                uint32_t nlink = S_ISDIR(e.mode) ? 2 : 1;
+                write_entry(ino++, e, nlink, e.target);
+                continue;
+            }
+            Blob& b = blobs[static_cast<size_t>(e.blob)];
+            if (b.ino == 0)
+                b.ino = ino++;
+            static const std::string none;
+            write_entry(b.ino, e, b.links, b.written ? none : b.data);
+            b.written = true;
+        }
+        Entry trailer;
+        trailer.name = "TRAILER!!!";
+        write_entry(0, trailer, 1, {});
+        pad(512);
+    }
+};
+
+static bool fail(const std::string& where, const std::string& msg)
+{
+    std::fprintf(stderr, "ERROR: mkinitramfs: %s: %s\n", where.c_str(), msg.c_str());
+    return false;
+}
+
+static std::string expand_env(const std::string& s)
+{
+    std::string r;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        size_t close = s[i] == '$' && i + 1 < s.size() && s[i + 1] == '{' ? s.find('}', i) : std::string::npos;
+        if (close == std::string::npos)
+        {
+            r += s[i];
+            continue;
+        }
+        const char* v = std::getenv(s.substr(i + 2, close - i - 2).c_str());
+        r += v ? v : "";
+        i = close;
+    }
+    return r;
+}
+
+static bool read_file(const std::string& path, std::string& data)
+{
+    FD fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st{};
+    if (!fd || fstat(fd.get(), &st) != 0)
+        return false;
+    data.resize(static_cast<size_t>(st.st_size));
+    size_t got = 0;
+    while (got < data.size())
+    {
+        ssize_t n = read(fd.get(), &data[got], data.size() - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool parse_spec(const char* path, Archive& ar)
+{
+    std::ifstream in(path);
+    if (!in)
+        return fail(path, strerror(errno));
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); ++lineno)
+    {
+        std::string where = std::string(path) + ":" + std::to_string(lineno);
+        std::istringstream ss(line.substr(0, line.find('#')));
+        std::string kind, name;
+        if (!(ss >> kind))
+            continue;
+        if (!(ss >> name) || name.find_first_not_of('/') == std::string::npos)
+            return fail(where, "missing name");
+        Entry e;
+        e.name = name.substr(name.find_first_not_of('/'));
+        std::string location;
+        if (kind == "file" || kind == "slink")
+            ss >> location;
+        std::string mode;
+        ss >> mode >> e.uid >> e.gid;
+        if (!ss)
+            return fail(where, "expected <mode> <uid> <gid>");
+        e.mode = static_cast<uint32_t>(std::strtoul(mode.c_str(), nullptr, 8)) & 07777;
+
+        std::vector<std::string> links;
+        if (kind == "dir")
+            e.mode |= S_IFDIR;
+        else if (kind == "pipe")
+            e.mode |= S_IFIFO;
+        else if (kind == "sock")
+            e.mode |= S_IFSOCK;
+        else if (kind == "slink")
+        {
+            e.mode |= S_IFLNK;
+            e.target = location;
+        }
+        else if (kind == "nod")
+        {
+            char type = 0;
+            if (!(ss >> type >> e.rdev_major >> e.rdev_minor) || (type != 'b' && type != 'c'))
+                return fail(where, "expected <b|c> <major> <minor>");
+            e.mode |= type == 'b' ? S_IFBLK : S_IFCHR;
+        }
+        else if (kind == "file")
+        {
+            e.mode |= S_IFREG;
+            std::string source = expand_env(location), data;
+            if (!read_file(source, data))
+                return fail(where, source + ": " + strerror(errno));
+            e.blob = ar.add_blob(std::move(data));
+            for (std::string link; ss >> link;)
+            {
+                if (link.find_first_not_of('/') == std::string::npos)
+                    return fail(where, "bad link name");
+                links.push_back(link.substr(link.find_first_not_of('/')));
+            }
+        }
+        else
+        {
+            return fail(where, "unknown entry type '" + kind + "'");
+        }
+
+        links.insert(links.begin(), e.name);
+        for (const std::string& n : links)
+        {
+            if (ar.has(n))
+                return fail(where, "duplicate entry '/" + n + "'");
+            if (n != e.name)
+                ar.blobs[static_cast<size_t>(e.blob)].links++;
+            e.name = n;
+            ar.entries.push_back(e);
+        }
+    }
+    return true;
+}
+
+static bool write_output(const std::string& data, const char* path, const Compressor& c, int level)
+{
+    FD out(path ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : dup(STDOUT_FILENO));
+    if (!out)
+        return fail(path ? path : "stdout", strerror(errno));
+    if (!c.program)
+        return write_all(out.get(), data.data(), data.size()) || fail(path ? path : "stdout", strerror(errno));
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return fail("pipe", strerror(errno));
+    FD rd(fds[0]), wr(fds[1]);
+    std::string lvl = "-" + std::to_string(level);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(rd.get(), STDIN_FILENO);
+        dup2(out.get(), STDOUT_FILENO);
+        execlp(c.program, c.program, c.flags, "-c", lvl.c_str(), static_cast<char*>(nullptr));
+        std::fprintf(stderr, "ERROR: mkinitramfs: %s: %s\n", c.program, strerror(errno));
+        _exit(127);
+    }
+    if (pid < 0)
+        return fail("fork", strerror(errno));
+    rd = FD();
+    signal(SIGPIPE, SIG_IGN); // a dead compressor is reported by its status
+    bool ok = write_all(wr.get(), data.data(), data.size());
+    wr = FD();
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return fail(c.program, "compressor failed");
+    return ok || fail(c.program, "short write");
+}
+
+int main(int argc, char** argv)
+{
+    Archive ar;
+    const char* output = nullptr;
+    const Compressor* comp = &COMPRESSORS[0];
+    int level = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:c:l:a:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            comp = nullptr;
+            for (const Compressor& c : COMPRESSORS)
+            {
+                if (std::strcmp(c.name, optarg) == 0)
+                    comp = &c;
+            }
+            if (!comp)
+            {
+                fail(optarg, "unknown compression (none, gzip, lz4, zstd)");
+                return 2;
+            }
+            break;
+        case 'l':
+            level = std::atoi(optarg);
+            break;
+        case 'a': // best-effort, see write_entry
+            ar.align = std::strtoul(optarg, nullptr, 0);
+            if (ar.align < 4 || (ar.align & (ar.align - 1)) != 0)
+            {
+                fail(optarg, "alignment must be a power of two >= 4");
+                return 2;
+            }
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-o out] [-c none|gzip|lz4|zstd] [-l level] [-a align] spec...\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc)
+    {
+        std::fprintf(stderr, "usage: %s [-o out] [-c none|gzip|lz4|zstd] [-l level] [-a align] spec...\n", argv[0]);
+        return 2;
+    }
+    if (const char* epoch = std::getenv("SOURCE_DATE_EPOCH"))
+        ar.mtime = static_cast<uint32_t>(std::strtoul(epoch, nullptr, 10));
+
+    for (int i = optind; i < argc; ++i)
+    {
+        if (!parse_spec(argv[i], ar))
+            return 1;
+    }
+    ar.add_parents();
+    ar.write();
+    return write_output(ar.out, output, *comp, level < 0 ? comp->level : level) ? 0 : 1;
+}